@@ -0,0 +1,189 @@
+#include <benchmark/benchmark.h>
+#include <sstream>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+constexpr int REPEATS = 1024;
+
+// Program that spends most of its instructions in the given op.
+static Bytecode MakeProgram(Op op)
+{
+    std::vector<Command> program;
+    program.emplace_back(Command{ Opcode::PUSH, Any(1) });
+    for (int i = 0; i < REPEATS; i++) {
+        switch (op) {
+            case Op::PUSH_MONO:
+                program.emplace_back(Command{ Opcode::PUSH });
+                break;
+            case Op::PUSH_INT:
+                program.emplace_back(Command{ Opcode::PUSH, Any(i) });
+                break;
+            case Op::PUSH_CONST:
+                program.emplace_back(Command{ Opcode::PUSH, Any(1.5f) });
+                break;
+            case Op::ADD:
+            case Op::SUB:
+            case Op::MUL:
+            case Op::DIV:
+                program.emplace_back(Command{ Opcode::PUSH, Any(1) });
+                program.emplace_back(Command{ SourceOpcode(op) });
+                break;
+            case Op::CALL:
+                program.emplace_back(Command{ Opcode::CALL, Any("nop") });
+                break;
+            default:
+                // typed ops are only reached by quickening
+                break;
+        }
+    }
+    return Assemble(program);
+}
+
+template <Op op, DispatchMode mode>
+static void BM_Dispatch(benchmark::State& state)
+{
+    Bytecode program = MakeProgram(op);
+    VirtualMachine base("bench");
+    base.Register("nop", [](HookContext&&) { return Any(1); });
+
+    for (auto _ : state) {
+        VirtualMachine vm = base;
+        vm.Run(program, mode);
+        benchmark::DoNotOptimize(vm);
+    }
+    state.SetItemsProcessed(state.iterations() * program.code.size());
+}
+
+#define DISPATCH_BENCHMARK(OP) \
+    BENCHMARK(BM_Dispatch<Op::OP, DispatchMode::SWITCH>)->Name("BM_Dispatch/" #OP "/switch"); \
+    BENCHMARK(BM_Dispatch<Op::OP, DispatchMode::THREADED>)->Name("BM_Dispatch/" #OP "/threaded");
+
+DISPATCH_BENCHMARK(PUSH_MONO)
+DISPATCH_BENCHMARK(PUSH_INT)
+DISPATCH_BENCHMARK(PUSH_CONST)
+DISPATCH_BENCHMARK(ADD)
+DISPATCH_BENCHMARK(SUB)
+DISPATCH_BENCHMARK(MUL)
+DISPATCH_BENCHMARK(DIV)
+DISPATCH_BENCHMARK(CALL)
+
+// Generic arithmetic on every run against the quickened steady state.
+static void BM_Quickening(benchmark::State& state)
+{
+    const Bytecode pristine = MakeProgram(Op::MUL);
+    const bool quickened = state.range(0) != 0;
+    Bytecode program = pristine;
+
+    for (auto _ : state) {
+        if (!quickened) {
+            state.PauseTiming();
+            program = pristine;
+            state.ResumeTiming();
+        }
+        VirtualMachine vm("bench");
+        vm.Run(program);
+        benchmark::DoNotOptimize(vm);
+    }
+    state.SetItemsProcessed(state.iterations() * program.code.size());
+}
+BENCHMARK(BM_Quickening)->ArgName("quickened")->Arg(0)->Arg(1);
+
+// The PUSH <const> / arithmetic and PUSH / CALL pairs against their
+// superinstructions.
+static void BM_Superinstructions(benchmark::State& state)
+{
+    std::vector<Command> program;
+    program.emplace_back(Command{ Opcode::PUSH, Any(1) });
+    for (int i = 0; i < REPEATS; i++) {
+        program.emplace_back(Command{ Opcode::PUSH, Any(3) });
+        program.emplace_back(Command{ Opcode::MUL });
+        program.emplace_back(Command{ Opcode::PUSH, Any(1) });
+        program.emplace_back(Command{ Opcode::CALL, Any("nop") });
+    }
+    Bytecode bytecode = Assemble(state.range(0) != 0 ? Optimize(program) : program);
+
+    VirtualMachine base("bench");
+    base.Register("nop", [](HookContext&&) { return Any(1); });
+    for (auto _ : state) {
+        VirtualMachine vm = base;
+        vm.Run(bytecode);
+        benchmark::DoNotOptimize(vm);
+    }
+    state.SetItemsProcessed(state.iterations() * program.size());
+}
+BENCHMARK(BM_Superinstructions)->ArgName("fused")->Arg(0)->Arg(1);
+
+// Hook calls reading their arguments straight from the stack.
+static void BM_CallArgs(benchmark::State& state)
+{
+    const int argc = static_cast<int>(state.range(0));
+    std::vector<Command> program;
+    for (int i = 0; i < REPEATS / argc; i++) {
+        for (int j = 0; j < argc; j++) {
+            program.emplace_back(Command{ Opcode::PUSH, Any(j) });
+        }
+        program.emplace_back(Command{ Opcode::CALL, Any("count") });
+    }
+    Bytecode bytecode = Assemble(program);
+
+    VirtualMachine base("bench");
+    base.Register("count", [](HookContext&& ctx) { return Any(static_cast<int>(ctx.args.size())); }, argc);
+    for (auto _ : state) {
+        VirtualMachine vm = base;
+        vm.Run(bytecode);
+        benchmark::DoNotOptimize(vm);
+    }
+    state.SetItemsProcessed(state.iterations() * (REPEATS / argc));
+}
+BENCHMARK(BM_CallArgs)->ArgName("argc")->Arg(1)->Arg(8)->Arg(64);
+
+// The same function as a HookFunc unpacking its arguments and bound natively.
+static void BM_NativeCall(benchmark::State& state)
+{
+    // every call takes the previous result as t, so the stack stays shallow
+    std::vector<Command> program;
+    program.emplace_back(Command{ Opcode::PUSH, Any(0.5f) });
+    for (int i = 0; i < REPEATS; i++) {
+        program.emplace_back(Command{ Opcode::PUSH, Any(1.0f) });
+        program.emplace_back(Command{ Opcode::PUSH, Any(0.0f) });
+        program.emplace_back(Command{ Opcode::CALL, Any("lerp") });
+    }
+    Bytecode bytecode = Assemble(program);
+
+    VirtualMachine base("bench");
+    if (state.range(0) != 0) {
+        base.Bind("lerp", +[](float a, float b, float t) { return a + (b - a) * t; });
+    } else {
+        base.Register("lerp", [](HookContext&& ctx) {
+            const float a = ctx.args[0].Number<float>();
+            const float b = ctx.args[1].Number<float>();
+            const float t = ctx.args[2].Number<float>();
+            return Any(a + (b - a) * t);
+        }, 3);
+    }
+    for (auto _ : state) {
+        VirtualMachine vm = base;
+        vm.Run(bytecode);
+        benchmark::DoNotOptimize(vm);
+    }
+    state.SetItemsProcessed(state.iterations() * REPEATS);
+}
+BENCHMARK(BM_NativeCall)->ArgName("bound")->Arg(0)->Arg(1);
+
+// Cost of collecting a profile while running arithmetic and calls.
+static void BM_Profiling(benchmark::State& state)
+{
+    Bytecode program = MakeProgram(Op::ADD);
+    VirtualMachine base("bench");
+    base.SetProfiling(state.range(0) != 0);
+
+    for (auto _ : state) {
+        VirtualMachine vm = base;
+        vm.Run(program);
+        benchmark::DoNotOptimize(vm);
+    }
+    state.SetItemsProcessed(state.iterations() * program.code.size());
+}
+BENCHMARK(BM_Profiling)->ArgName("profiled")->Arg(0)->Arg(1);
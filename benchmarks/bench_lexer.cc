@@ -0,0 +1,152 @@
+#include <benchmark/benchmark.h>
+#include <sstream>
+#include <string>
+
+#include "theatre/lexer.hh"
+#include "theatre/parser.hh"
+#include "theatre/scan.hh"
+
+using namespace theatre;
+
+// Source of at least the given size made of function declarations.
+static std::string GenerateSource(size_t size)
+{
+    std::string source;
+    while (source.size() < size) {
+        source += "fn takeSum(int a, int b) int {\n"
+                  "    mut float offset = a * b - a / 2.5;\n"
+                  "    print(\"sum\", offset);\n"
+                  "    return a + offset;\n"
+                  "}\n\n";
+    }
+    return source;
+}
+
+static void BM_LexText(benchmark::State& state)
+{
+    const std::string source = GenerateSource(state.range(0));
+    size_t tokens = 0;
+    size_t memory = 0;
+    for (auto _ : state) {
+        std::vector<Token> lexed = LexText(source);
+        tokens += lexed.size();
+        memory = lexed.capacity() * sizeof(Token);
+        benchmark::DoNotOptimize(lexed);
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    state.SetItemsProcessed(tokens);
+    state.counters["memory"] = benchmark::Counter(memory, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_LexText)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+
+// The same sources into compact tokens, memory includes the kept source.
+static void BM_LexBuffer(benchmark::State& state)
+{
+    const std::string source = GenerateSource(state.range(0));
+    size_t tokens = 0;
+    size_t memory = 0;
+    for (auto _ : state) {
+        TokenBuffer buffer(source);
+        tokens += buffer.size();
+        memory = buffer.SizeInBytes();
+        benchmark::DoNotOptimize(buffer);
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    state.SetItemsProcessed(tokens);
+    state.counters["memory"] = benchmark::Counter(memory, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_LexBuffer)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+
+// The same sources pulled a token at a time from a stream, memory is the input window.
+static void BM_LexStream(benchmark::State& state)
+{
+    const std::string source = GenerateSource(state.range(0));
+    size_t tokens = 0;
+    size_t memory = 0;
+    for (auto _ : state) {
+        std::istringstream in(source);
+        TokenStream stream(ReadChunks(in));
+        for (const Token& token : stream) {
+            benchmark::DoNotOptimize(token);
+            tokens++;
+        }
+        memory = stream.WindowSize();
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    state.SetItemsProcessed(tokens);
+    state.counters["memory"] = benchmark::Counter(memory, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_LexStream)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+
+// A keystroke in the middle of a source and its undo, against lexing it again.
+static void BM_EditBuffer(benchmark::State& state)
+{
+    std::string source = GenerateSource(state.range(0));
+    TokenBuffer buffer(source);
+    const size_t offset = source.find("offset", source.size() / 2);
+    const bool incremental = state.range(1);
+    for (auto _ : state) {
+        if (incremental) {
+            buffer.Edit({ offset, 0, "x" });
+            buffer.Edit({ offset, 1, "" });
+        } else {
+            source.insert(offset, "x");
+            TokenBuffer edited(source);
+            source.erase(offset, 1);
+            TokenBuffer undone(source);
+            benchmark::DoNotOptimize(edited);
+            benchmark::DoNotOptimize(undone);
+        }
+        benchmark::DoNotOptimize(buffer);
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_EditBuffer)->ArgNames({ "size", "incremental" })->ArgsProduct({ { 1 << 16, 1 << 22 }, { 0, 1 } });
+
+// Indented sources with long whitespace runs, and sources of long names.
+static std::string GenerateShape(bool identifiers, size_t size)
+{
+    std::string source;
+    while (source.size() < size) {
+        if (identifiers) {
+            source += "mut int averageFrameTimeInMilliseconds = previousFrameTimeInMilliseconds_2;\n";
+        } else {
+            source += "\n\n                                a   =   b   +   c   ;\n            \t\t\n";
+        }
+    }
+    return source;
+}
+
+static void BM_ScanKernels(benchmark::State& state)
+{
+    const ScanKernels* kernels = ScanKernels::Get(static_cast<ScanLevel>(state.range(0)));
+    if (!kernels) {
+        state.SkipWithError("Not supported on this CPU");
+        return;
+    }
+    const bool identifiers = state.range(1);
+    const std::string source = GenerateShape(identifiers, 1 << 20);
+    const ScanKernels::Kernel skip = identifiers ? kernels->skipIdent : kernels->skipSpace;
+
+    // skips every run of the class, stepping over the character ending it
+    for (auto _ : state) {
+        const char* end = source.data() + source.size();
+        for (const char* it = source.data(); it < end; it = skip(it, end) + 1) {
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    state.SetLabel(std::string(magic_enum::enum_name(kernels->level)));
+}
+BENCHMARK(BM_ScanKernels)->ArgNames({ "level", "identifiers" })->ArgsProduct({ { 0, 1, 2 }, { 0, 1 } });
+
+static void BM_LexShapes(benchmark::State& state)
+{
+    const std::string source = GenerateShape(state.range(0), 1 << 20);
+    for (auto _ : state) {
+        TokenBuffer buffer(source);
+        benchmark::DoNotOptimize(buffer);
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_LexShapes)->ArgName("identifiers")->Arg(0)->Arg(1);
@@ -0,0 +1,107 @@
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <sstream>
+#include <string>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+// Roughly 4 MB of TASM mixing every kind of operand.
+static const std::string& GeneratedScript()
+{
+    static const std::string script = [] {
+        std::string text;
+        for (int i = 0; text.size() < 4 * 1024 * 1024; i++) {
+            text += "PUSH " + std::to_string(i) + "\n";
+            text += "PUSH " + std::to_string(i) + ".5\n";
+            text += "MUL\n";
+            text += "    push hello world\n";
+            text += "PUSH_CALL {} println\n";
+            text += "\n";
+        }
+        return text;
+    }();
+    return script;
+}
+
+// The loader RunScript used before, a stream copying out every line.
+static std::vector<Command> ParseScriptWithStream(std::string_view script)
+{
+    std::istringstream iss{ std::string(script) };
+    std::vector<Command> cmds;
+    std::string line;
+    while (std::getline(iss, line)) {
+        std::optional<Command> cmd = ParseLine(line);
+        if (cmd.has_value()) {
+            cmds.emplace_back(*cmd);
+        }
+    }
+    return cmds;
+}
+
+static void BM_LoadScript(benchmark::State& state)
+{
+    const std::string& script = GeneratedScript();
+    const bool views = state.range(0);
+    for (auto _ : state) {
+        std::vector<Command> program = views ? ParseScript(script) : ParseScriptWithStream(script);
+        benchmark::DoNotOptimize(program);
+    }
+    state.SetBytesProcessed(state.iterations() * script.size());
+}
+BENCHMARK(BM_LoadScript)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+static void BM_ParseLine(benchmark::State& state)
+{
+    const std::string_view lines[] = {
+        "PUSH 42", "  push 1.5  ", "PUSH hello world", "ADD", "CALL print 2", "PUSH_CALL {} println", ""
+    };
+    for (auto _ : state) {
+        for (const std::string_view line : lines) {
+            benchmark::DoNotOptimize(ParseLine(line));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * std::size(lines));
+}
+BENCHMARK(BM_ParseLine);
+
+// The linear scan over every Opcode name ParseLine used before.
+static std::optional<Opcode> FindOpcodeLinear(std::string_view mnemonic)
+{
+    for (const auto& [code, name] : magic_enum::enum_entries<Opcode>()) {
+        if (EqualsIgnoringCase(mnemonic, name)) {
+            return code;
+        }
+    }
+    return std::nullopt;
+}
+
+static void BM_FindOpcode(benchmark::State& state)
+{
+    const std::vector<std::string> mnemonics = { "PUSH", "push", "ADD", "PUSH_CALL", "div_const", "CALL" };
+    const bool hashed = state.range(0);
+    for (auto _ : state) {
+        for (const std::string& mnemonic : mnemonics) {
+            benchmark::DoNotOptimize(hashed ? FindOpcode(mnemonic) : FindOpcodeLinear(mnemonic));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * std::size(mnemonics));
+}
+BENCHMARK(BM_FindOpcode)->Arg(0)->Arg(1);
+
+// Getting the generated script ready to run, from TASM or from a .tbc file.
+static void BM_LoadProgram(benchmark::State& state)
+{
+    const std::string& script = GeneratedScript();
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "theatre_bench.tbc";
+    SaveBytecode(path, Assemble(ParseScript(script)));
+
+    const bool mapped = state.range(0);
+    for (auto _ : state) {
+        Bytecode program = mapped ? LoadBytecode(path) : Assemble(ParseScript(script));
+        benchmark::DoNotOptimize(program);
+    }
+    std::filesystem::remove(path);
+}
+BENCHMARK(BM_LoadProgram)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,28 @@
+#include <benchmark/benchmark.h>
+#include <string>
+
+#include "theatre/types.hh"
+
+using namespace theatre;
+
+// Any arithmetic the unoptimized paths and the constant folder use,
+// per pair of operand types.
+static void BM_AnyArithmetic(benchmark::State& state)
+{
+    const std::pair<Any, Any> operands[] = {
+        { Any(7), Any(3) },
+        { Any(7.5f), Any(3) },
+        { Any("hello "), Any("world") },
+    };
+    const auto& [a, b] = operands[state.range(0)];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(a + b);
+        if (state.range(0) != 2) {
+            benchmark::DoNotOptimize(a - b);
+            benchmark::DoNotOptimize(a * b);
+            benchmark::DoNotOptimize(a / b);
+        }
+    }
+    state.SetLabel(std::string(a.GetTypeName()) + ", " + b.GetTypeName());
+}
+BENCHMARK(BM_AnyArithmetic)->DenseRange(0, 2);
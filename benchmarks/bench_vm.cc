@@ -0,0 +1,118 @@
+#include <benchmark/benchmark.h>
+#include <string>
+#include <sstream>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+static VirtualMachine MakeVm(int64_t depth, int64_t hookCount)
+{
+    VirtualMachine vm("bench");
+    vm.Init();
+    for (int64_t i = 0; i < hookCount; i++) {
+        vm.Register("hook" + std::to_string(i), [](HookContext&&) { return Any(); });
+    }
+    for (int64_t i = 0; i < depth; i++) {
+        vm = vm.PushStack(Any(static_cast<int>(i)));
+    }
+    return vm;
+}
+
+// Copying a machine should not depend on how much state it holds.
+static void BM_CopyVm(benchmark::State& state)
+{
+    const VirtualMachine vm = MakeVm(state.range(0), state.range(1));
+    for (auto _ : state) {
+        VirtualMachine copy = vm;
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(BM_CopyVm)->ArgsProduct({ benchmark::CreateRange(1, 1 << 14, 8), { 0, 1024 } });
+
+// Pure Execute while keeping the older machine alive, like undo does.
+static void BM_ExecuteAdd(benchmark::State& state)
+{
+    const VirtualMachine vm = MakeVm(state.range(0), state.range(1));
+    const Command add{ Opcode::ADD };
+    for (auto _ : state) {
+        VirtualMachine next = vm.Execute(add);
+        benchmark::DoNotOptimize(next);
+    }
+}
+BENCHMARK(BM_ExecuteAdd)->ArgsProduct({ benchmark::CreateRange(2, 1 << 14, 8), { 0, 1024 } });
+
+// Pure Execute of one instruction of every TASM opcode on a shallow stack.
+static void BM_ExecuteOpcode(benchmark::State& state)
+{
+    const Opcode code = magic_enum::enum_value<Opcode>(state.range(0));
+    Command cmd{ code };
+    switch (code) {
+        case Opcode::PUSH:
+        case Opcode::ADD_CONST:
+        case Opcode::SUB_CONST:
+        case Opcode::MUL_CONST:
+        case Opcode::DIV_CONST:
+            cmd.value = Any(2);
+            break;
+        case Opcode::CALL:
+            cmd.value = Any("nop");
+            break;
+        case Opcode::PUSH_CALL:
+            cmd.value = Any(2);
+            cmd.operand = Any("nop");
+            break;
+        default:
+            break;
+    }
+
+    VirtualMachine vm("bench");
+    vm.Register("nop", [](HookContext&&) { return Any(); }, 1);
+    vm = vm.PushStack(Any(3)).PushStack(Any(4));
+    for (auto _ : state) {
+        VirtualMachine next = vm.Execute(cmd);
+        benchmark::DoNotOptimize(next);
+    }
+    state.SetLabel(std::string(magic_enum::enum_name(code)));
+}
+BENCHMARK(BM_ExecuteOpcode)->DenseRange(0, magic_enum::enum_count<Opcode>() - 1);
+
+static void BM_PushPopStack(benchmark::State& state)
+{
+    const VirtualMachine vm = MakeVm(state.range(0), 0);
+    for (auto _ : state) {
+        Any value;
+        VirtualMachine next = vm.PushStack(Any(1)).PopStack(&value);
+        benchmark::DoNotOptimize(next);
+    }
+}
+BENCHMARK(BM_PushPopStack)->Range(1, 1 << 14);
+
+// Constructing a machine with the standard library, as RunScript does.
+static void BM_CreateVm(benchmark::State& state)
+{
+    for (auto _ : state) {
+        VirtualMachine vm("default");
+        vm.Init();
+        benchmark::DoNotOptimize(vm);
+    }
+}
+BENCHMARK(BM_CreateVm);
+
+// RunScript on the same text, cold compiles it every time.
+static void BM_RunScript(benchmark::State& state)
+{
+    std::string script;
+    for (int i = 0; i < 256; i++) {
+        script += "PUSH " + std::to_string(i) + "\nPUSH 2\nMUL\nPUSH 1\nADD\n";
+    }
+    const bool cached = state.range(0);
+    std::stringstream out;
+    for (auto _ : state) {
+        if (!cached) {
+            ScriptCache::ForThread().Clear();
+        }
+        benchmark::DoNotOptimize(RunScript(script, out));
+    }
+}
+BENCHMARK(BM_RunScript)->Arg(0)->Arg(1);
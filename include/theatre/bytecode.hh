@@ -0,0 +1,398 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <stdexcept>
+#include <magic_enum.hpp>
+
+#include "types.hh"
+#include "value.hh"
+
+namespace theatre {
+
+using AssembleError = std::runtime_error;
+
+// TASM instruction set
+enum class Opcode : int
+{
+    PUSH,
+    SUB,
+    MUL,
+    DIV,
+    ADD,
+    CALL,
+
+    // superinstructions formed by the optimizer,
+    // <op>_CONST x behaves like PUSH x followed by <op>
+    ADD_CONST,
+    SUB_CONST,
+    MUL_CONST,
+    DIV_CONST,
+    PUSH_CALL, // PUSH value followed by CALL operand
+};
+
+class Command
+{
+public:
+    Opcode code;
+    Any value{};
+    Any operand{}; // second operand of superinstructions
+
+    friend std::ostream& operator<<(std::ostream& os, const Command& cmd) {
+        os << magic_enum::enum_name<Opcode>(cmd.code) << " " << cmd.value;
+        if (!cmd.operand.IsMono()) {
+            os << " " << cmd.operand;
+        }
+        return os;
+    }
+};
+
+constexpr char AsciiToLower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+constexpr bool EqualsIgnoringCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (AsciiToLower(a[i]) != AsciiToLower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hashes the length and the first and last letters, which tells all
+// mnemonics apart while costing the same for every line.
+constexpr uint32_t MnemonicHash(std::string_view text, uint32_t seed) {
+    if (text.empty()) {
+        return 0;
+    }
+    const uint32_t first = static_cast<uint8_t>(AsciiToLower(text.front()));
+    const uint32_t last = static_cast<uint8_t>(AsciiToLower(text.back()));
+    return ((first * 31 + last) * 31 + static_cast<uint32_t>(text.size())) * (seed * 2 + 1) >> 16;
+}
+
+// Perfect hash from TASM mnemonics to opcodes, built at compile time by
+// searching for a seed under which no two Opcode names share a slot.
+class MnemonicTable
+{
+public:
+    static constexpr size_t OPCODES = magic_enum::enum_count<Opcode>();
+    static constexpr size_t SIZE = std::bit_ceil(OPCODES * 2);
+
+    consteval MnemonicTable() {
+        for (seed = 0; seed < MAX_SEED; seed++) {
+            if (TryFill()) {
+                return;
+            }
+        }
+        throw "Opcode names collide in MnemonicHash";
+    }
+
+    constexpr std::optional<Opcode> Find(std::string_view mnemonic) const {
+        const Slot& slot = slots[MnemonicHash(mnemonic, seed) & (SIZE - 1)];
+        // anything else can hash to a used slot too
+        if (slot.name.empty() || !EqualsIgnoringCase(mnemonic, slot.name)) {
+            return std::nullopt;
+        }
+        return slot.code;
+    }
+
+private:
+    static constexpr uint32_t MAX_SEED = 1 << 16;
+
+    struct Slot
+    {
+        std::string_view name; // empty when unused
+        Opcode code {};
+    };
+
+    uint32_t seed = 0;
+    std::array<Slot, SIZE> slots {};
+
+    constexpr bool TryFill() {
+        slots.fill(Slot{});
+        for (const auto& [code, name] : magic_enum::enum_entries<Opcode>()) {
+            Slot& slot = slots[MnemonicHash(name, seed) & (SIZE - 1)];
+            if (!slot.name.empty()) {
+                return false;
+            }
+            slot = Slot{ name, code };
+        }
+        return true;
+    }
+};
+
+inline constexpr MnemonicTable MNEMONICS;
+
+constexpr std::optional<Opcode> FindOpcode(std::string_view mnemonic) {
+    return MNEMONICS.Find(mnemonic);
+}
+
+// Packed instruction set the virtual machine executes.
+// Every instruction is one 32-bit word: the op in the low 8 bits and
+// a 24-bit operand (immediate or constant pool index) above it.
+enum class Op : uint8_t
+{
+    PUSH_MONO,
+    PUSH_INT,   // signed immediate
+    PUSH_CONST, // constant index
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    CALL,       // pair of import index and argument count
+
+    // Typed variants the generic arithmetic ops are quickened into at
+    // runtime, once they have seen the types of their operands.
+    ADD_II,
+    ADD_FF,
+    ADD_SS,
+    SUB_II,
+    SUB_FF,
+    MUL_II,
+    MUL_FF,
+    DIV_II,
+    DIV_FF,
+
+    // arithmetic with a constant operand, constant index
+    ADD_CONST,
+    SUB_CONST,
+    MUL_CONST,
+    DIV_CONST,
+    PUSH_CALL,  // pair of constant index and import index
+};
+
+using Instruction = uint32_t;
+
+constexpr int OPERAND_BITS = 24;
+constexpr int32_t MAX_IMMEDIATE = (1 << (OPERAND_BITS - 1)) - 1;
+constexpr int32_t MIN_IMMEDIATE = -(1 << (OPERAND_BITS - 1));
+constexpr uint32_t MAX_OPERAND = (1u << OPERAND_BITS) - 1;
+
+constexpr Instruction Encode(Op op, uint32_t operand = 0) {
+    return static_cast<uint32_t>(op) | (operand << 8);
+}
+
+constexpr Instruction EncodeImmediate(Op op, int32_t value) {
+    return Encode(op, static_cast<uint32_t>(value) & MAX_OPERAND);
+}
+
+constexpr Op OpOf(Instruction ins) {
+    return static_cast<Op>(ins & 0xFF);
+}
+
+constexpr uint32_t OperandOf(Instruction ins) {
+    return ins >> 8;
+}
+
+constexpr int32_t ImmediateOf(Instruction ins) {
+    // arithmetic shift keeps the sign of the immediate
+    return static_cast<int32_t>(ins) >> 8;
+}
+
+// Ops with two constant operands split the operand in two halves.
+constexpr int PAIR_BITS = OPERAND_BITS / 2;
+constexpr uint32_t MAX_PAIR_OPERAND = (1u << PAIR_BITS) - 1;
+
+constexpr Instruction EncodePair(Op op, uint32_t first, uint32_t second) {
+    return Encode(op, first | (second << PAIR_BITS));
+}
+
+constexpr uint32_t FirstOf(Instruction ins) {
+    return OperandOf(ins) & MAX_PAIR_OPERAND;
+}
+
+constexpr uint32_t SecondOf(Instruction ins) {
+    return OperandOf(ins) >> PAIR_BITS;
+}
+
+// CALL without an explicit argument count
+constexpr uint32_t NO_ARGC = MAX_PAIR_OPERAND;
+
+// TASM opcode an op was assembled from
+constexpr Opcode SourceOpcode(Op op) {
+    switch (op) {
+        case Op::ADD:
+        case Op::ADD_II:
+        case Op::ADD_FF:
+        case Op::ADD_SS:
+            return Opcode::ADD;
+        case Op::SUB:
+        case Op::SUB_II:
+        case Op::SUB_FF:
+            return Opcode::SUB;
+        case Op::MUL:
+        case Op::MUL_II:
+        case Op::MUL_FF:
+            return Opcode::MUL;
+        case Op::DIV:
+        case Op::DIV_II:
+        case Op::DIV_FF:
+            return Opcode::DIV;
+        case Op::CALL: return Opcode::CALL;
+        case Op::ADD_CONST: return Opcode::ADD_CONST;
+        case Op::SUB_CONST: return Opcode::SUB_CONST;
+        case Op::MUL_CONST: return Opcode::MUL_CONST;
+        case Op::DIV_CONST: return Opcode::DIV_CONST;
+        case Op::PUSH_CALL: return Opcode::PUSH_CALL;
+        default: return Opcode::PUSH;
+    }
+}
+
+// Deduplicated, append-only list of values. Indices stay valid forever.
+class ConstantPool
+{
+public:
+    uint32_t Add(const Value& value);
+
+    const Value& At(uint32_t index) const {
+        return values[index];
+    }
+
+    size_t Size() const {
+        return values.size();
+    }
+
+    size_t SizeInBytes() const;
+
+private:
+    // floats are compared by their bits so 0.0 and -0.0 stay apart
+    struct Hash {
+        size_t operator()(const Value& value) const {
+            return value.Hash();
+        }
+    };
+    struct Identical {
+        bool operator()(const Value& a, const Value& b) const {
+            return a.Identical(b);
+        }
+    };
+
+    std::vector<Value> values;
+    std::unordered_map<Value, uint32_t, Hash, Identical> indices;
+};
+
+// Instructions of a program, either owned or borrowed from memory kept
+// alive by an owner, like the pages of a mapped .tbc file. Borrowed
+// instructions are still quickened in place, so they must be writable.
+class InstructionStream
+{
+public:
+    InstructionStream() = default;
+
+    InstructionStream(std::span<Instruction> borrowed, std::shared_ptr<void> owner)
+        : borrowed(borrowed), owner(std::move(owner))
+    {
+    }
+
+    bool IsBorrowed() const {
+        return owner != nullptr;
+    }
+
+    Instruction* data() {
+        return owner ? borrowed.data() : owned.data();
+    }
+
+    const Instruction* data() const {
+        return owner ? borrowed.data() : owned.data();
+    }
+
+    size_t size() const {
+        return owner ? borrowed.size() : owned.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    Instruction& operator[](size_t index) {
+        return data()[index];
+    }
+
+    Instruction operator[](size_t index) const {
+        return data()[index];
+    }
+
+    Instruction back() const {
+        return data()[size() - 1];
+    }
+
+    Instruction* begin() { return data(); }
+    Instruction* end() { return data() + size(); }
+    const Instruction* begin() const { return data(); }
+    const Instruction* end() const { return data() + size(); }
+
+    void reserve(size_t count) {
+        Own();
+        owned.reserve(count);
+    }
+
+    void emplace_back(Instruction ins) {
+        Own();
+        owned.emplace_back(ins);
+    }
+
+private:
+    std::vector<Instruction> owned;
+    std::span<Instruction> borrowed;
+    std::shared_ptr<void> owner;
+
+    // appending copies borrowed instructions out first
+    void Own() {
+        if (owner) {
+            owned.assign(borrowed.begin(), borrowed.end());
+            borrowed = {};
+            owner.reset();
+        }
+    }
+};
+
+struct Hook;
+
+// Hooks a program's imports resolved to, valid for as long as the hook
+// tables they were resolved against are alive and unchanged.
+struct Linkage
+{
+    std::shared_ptr<const void> registry;
+    std::shared_ptr<const void> overlay;
+    std::vector<const Hook*> hooks; // indexed like Bytecode::imports
+};
+
+struct Bytecode
+{
+    InstructionStream code;
+    ConstantPool constants;
+    // names of the hooks the program calls, calls refer to them by index
+    // and the virtual machine resolves them once when the program is run
+    std::vector<Symbol> imports;
+    // left by the machine that last ran the program, so running it again
+    // on the same hooks skips linking
+    std::shared_ptr<const Linkage> linkage;
+
+    size_t SizeInBytes() const {
+        return code.size() * sizeof(Instruction) + constants.SizeInBytes()
+             + imports.size() * sizeof(Symbol);
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const Bytecode& program);
+};
+
+// String constants are shared through the given table, hook names are
+// interned into it. A PUSH_CALL whose constants do not fit a pair operand is
+// assembled as two instructions.
+Bytecode Assemble(const std::vector<Command>& program,
+                  StringTable& strings = StringTable::Global());
+
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#include "bytecode.hh"
+#include "strings.hh"
+
+namespace theatre {
+
+using BytecodeFileError = std::runtime_error;
+
+// Compiled programs on disk, .tbc files. All fields are little endian.
+//
+//   TbcHeader
+//   instructions  codeCount x uint32, as Bytecode::code
+//   constants     constantCount x TbcConstant
+//   imports       importCount x uint32, offsets of the hook names in strings
+//   strings       uint32 length followed by the characters, for every string
+//
+// Sections start at 4-byte aligned offsets so the instructions can be run
+// straight from the mapped file.
+constexpr char TBC_MAGIC[4] = { 'T', 'B', 'C', '\0' };
+constexpr uint16_t TBC_VERSION = 1;
+
+struct TbcSection
+{
+    uint32_t offset;
+    uint32_t count; // entries, bytes for strings
+};
+
+struct TbcHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t opCount; // Op values this file was written for
+    TbcSection code;
+    TbcSection constants;
+    TbcSection imports;
+    TbcSection strings;
+};
+
+struct TbcConstant
+{
+    uint32_t type;  // AnyType
+    uint32_t value; // bits of the int, float or bool, offset in strings
+};
+
+void WriteBytecode(std::ostream& out, const Bytecode& program);
+
+void SaveBytecode(const std::filesystem::path& path, const Bytecode& program);
+
+// Maps the file privately and runs its instructions from the mapped pages,
+// quickening only touches this process's copy of them. The header and every
+// operand are checked here once, constants are shared through the table and
+// imports interned into it.
+Bytecode LoadBytecode(const std::filesystem::path& path,
+                      StringTable& strings = StringTable::Global());
+
+};
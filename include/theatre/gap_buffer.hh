@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace theatre {
+
+// Sequence with a gap at the position of the last edit, so inserting and
+// erasing there only costs what changes. Moving the gap costs the elements
+// it passes. Elements after the gap may be stored differently than the ones
+// before it, MoveGap lets the owner convert the elements that cross.
+template <typename T>
+class GapBuffer
+{
+    static_assert(std::is_trivially_copyable_v<T>, "GapBuffer moves its elements with memmove");
+
+public:
+    GapBuffer() = default;
+
+    // the gap starts out at the end
+    explicit GapBuffer(std::vector<T> elements)
+        : items(std::move(elements)), gapStart(items.size()), gapEnd(items.size())
+    {
+    }
+
+    size_t size() const {
+        return items.size() - (gapEnd - gapStart);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // index the gap is in front of
+    size_t Gap() const {
+        return gapStart;
+    }
+
+    const T& operator[](size_t index) const {
+        return items[index < gapStart ? index : index + gapEnd - gapStart];
+    }
+
+    // the elements in front of the gap and behind it
+    std::span<const T> Before() const {
+        return std::span<const T>(items.data(), gapStart);
+    }
+
+    std::span<const T> After() const {
+        return std::span<const T>(items.data() + gapEnd, items.size() - gapEnd);
+    }
+
+    // the element at index, the ones following it are contiguous up to the gap
+    const T* Data(size_t index) const {
+        return &(*this)[index];
+    }
+
+    // cross(element, before) returns the element as it is stored on its new
+    // side, before is true when it moved in front of the gap
+    template <typename F>
+    void MoveGap(size_t index, F cross) {
+        while (gapStart < index) {
+            items[gapStart++] = cross(items[gapEnd++], true);
+        }
+        while (gapStart > index) {
+            items[--gapEnd] = cross(items[--gapStart], false);
+        }
+    }
+
+    void MoveGap(size_t index) {
+        if (index > gapStart) {
+            const size_t count = index - gapStart;
+            std::memmove(items.data() + gapStart, items.data() + gapEnd, count * sizeof(T));
+            gapEnd += count;
+        } else {
+            const size_t count = gapStart - index;
+            std::memmove(items.data() + gapEnd - count, items.data() + index, count * sizeof(T));
+            gapEnd -= count;
+        }
+        gapStart = index;
+    }
+
+    // drops count elements in front of the gap
+    void EraseBefore(size_t count) {
+        gapStart -= count;
+    }
+
+    // adds elements in front of the gap, growing it when it is too small
+    void Insert(std::span<const T> elements) {
+        if (gapEnd - gapStart < elements.size()) {
+            Grow(elements.size());
+        }
+        std::copy(elements.begin(), elements.end(), items.begin() + gapStart);
+        gapStart += elements.size();
+    }
+
+    size_t SizeInBytes() const {
+        return items.capacity() * sizeof(T);
+    }
+
+private:
+    void Grow(size_t count) {
+        const size_t after = items.size() - gapEnd;
+        const size_t capacity = std::max(items.size() * 2, size() + count + 64);
+        items.resize(capacity);
+        std::memmove(items.data() + capacity - after, items.data() + gapEnd, after * sizeof(T));
+        gapEnd = capacity - after;
+    }
+
+    std::vector<T> items;
+    size_t gapStart = 0;
+    size_t gapEnd = 0;
+};
+
+};
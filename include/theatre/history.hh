@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "types.hh"
+#include "value.hh"
+#include "persistent.hh"
+#include "bytecode.hh"
+
+namespace theatre {
+
+enum class HistoryMode
+{
+    OFF,
+    LAST_N, // fixed capacity ring buffer
+    FULL,
+};
+
+constexpr size_t DEFAULT_HISTORY_CAPACITY = 64;
+
+// Record of an executed instruction, mono when it took no operand.
+struct HistoryEntry
+{
+    Opcode code{};
+    Value operand;
+};
+
+class History
+{
+public:
+    explicit History(HistoryMode mode = HistoryMode::OFF,
+                     size_t capacity = DEFAULT_HISTORY_CAPACITY);
+
+    HistoryMode GetMode() const {
+        return mode;
+    }
+
+    bool IsEnabled() const {
+        return mode != HistoryMode::OFF;
+    }
+
+    size_t Size() const;
+
+    bool IsEmpty() const {
+        return Size() == 0;
+    }
+
+    void Record(Opcode code, const Value& operand);
+
+    // visits entries from the most recent one
+    template <typename F>
+    void ForEach(F visit) const {
+        if (mode == HistoryMode::FULL) {
+            for (const HistoryEntry& entry: full) {
+                visit(entry);
+            }
+        } else if (mode == HistoryMode::LAST_N) {
+            for (size_t i = 0; i < count; i++) {
+                visit((*ring)[(head + capacity - 1 - i) % capacity]);
+            }
+        }
+    }
+
+private:
+    HistoryMode mode;
+    size_t capacity;
+
+    // LAST_N, preallocated and copied on write when shared
+    std::shared_ptr<std::vector<HistoryEntry>> ring;
+    size_t head = 0; // next slot to write
+    size_t count = 0;
+
+    // FULL
+    PersistentList<HistoryEntry> full;
+};
+
+};
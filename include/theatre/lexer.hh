@@ -1,12 +1,18 @@
 #pragma once
+#include <cstdint>
 #include <string_view>
 #include <vector>
 #include <array>
+#include <functional>
+#include <iterator>
+#include <optional>
 #include <string>
 #include <sstream>
 #include <stdexcept>
 #include <magic_enum.hpp>
 
+#include "gap_buffer.hh"
+
 namespace theatre
 {
     using LexerError = std::runtime_error;
@@ -193,4 +199,283 @@ namespace theatre
     };
 
     std::vector<Token> LexText(const std::string_view &text);
+
+    // Reads up to size bytes into buffer and returns how many, 0 once the input is over.
+    using ChunkReader = std::function<size_t(char* buffer, size_t size)>;
+
+    ChunkReader ReadChunks(std::istream& in);
+
+    constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    // Lexes one token each time the next one is pulled. Input read through a
+    // ChunkReader is kept in a window of the unfinished token plus one chunk,
+    // so sources of any size lex in bounded memory.
+    class TokenStream
+    {
+    public:
+        // the text has to outlive the stream
+        explicit TokenStream(std::string_view text);
+
+        explicit TokenStream(ChunkReader reader, size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+        TokenStream(const TokenStream&) = delete;
+        TokenStream& operator=(const TokenStream&) = delete;
+
+        // std::nullopt after the last token
+        std::optional<Token> Next();
+
+        class Iterator
+        {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = Token;
+            using difference_type = std::ptrdiff_t;
+
+            Iterator() = default;
+
+            explicit Iterator(TokenStream* stream) : stream(stream)
+            {
+                ++*this;
+            }
+
+            const Token& operator*() const
+            {
+                return *current;
+            }
+
+            const Token* operator->() const
+            {
+                return &*current;
+            }
+
+            Iterator& operator++()
+            {
+                current.reset();
+                if (std::optional<Token> token = stream->Next()) {
+                    current.emplace(*token);
+                }
+                return *this;
+            }
+
+            void operator++(int)
+            {
+                ++*this;
+            }
+
+            friend bool operator==(const Iterator& it, std::default_sentinel_t)
+            {
+                return !it.current.has_value();
+            }
+
+        private:
+            TokenStream* stream = nullptr;
+            std::optional<Token> current;
+        };
+
+        // a stream is walked once, begin() pulls its next token
+        Iterator begin()
+        {
+            return Iterator(this);
+        }
+
+        std::default_sentinel_t end() const
+        {
+            return {};
+        }
+
+        // bytes of input held right now
+        size_t WindowSize() const
+        {
+            return buffer.capacity();
+        }
+
+    private:
+        void Refill();
+
+        ChunkReader reader;
+        size_t chunkSize = DEFAULT_CHUNK_SIZE;
+        std::string buffer;     // read input not yet lexed, when there is a reader
+        std::string_view window; // text the next token is lexed from
+        size_t pos = 0;
+        bool final = false;     // nothing follows the window
+        int row = 1;
+        int col = 1;
+    };
+
+    // 8-byte token referring to its text in the source of a TokenBuffer,
+    // unlike Token it is never truncated.
+    struct CompactToken
+    {
+        static constexpr uint32_t MAX_LENGTH = (1u << 24) - 1;
+
+        uint32_t offset;
+        uint32_t length : 24;
+        uint32_t type : 8; // TokenType
+
+        static constexpr CompactToken Of(TokenType type, uint32_t offset, uint32_t length)
+        {
+            return CompactToken{ offset, length, static_cast<uint32_t>(type) };
+        }
+
+        constexpr TokenType Type() const
+        {
+            return static_cast<TokenType>(type);
+        }
+
+        constexpr bool IsType(TokenType other) const
+        {
+            return Type() == other;
+        }
+    };
+    static_assert(sizeof(CompactToken) == 8, "CompactToken should stay 8 bytes");
+
+    struct SourcePosition
+    {
+        int row;
+        int col;
+    };
+
+    // Replaces removed characters at offset with inserted, which may not
+    // point into the source being edited.
+    struct TextEdit
+    {
+        size_t offset;
+        size_t removed;
+        std::string_view inserted;
+    };
+
+    // Tokens [first, first + removed) of a TokenBuffer were replaced by
+    // [first, first + inserted) when it was edited.
+    struct TokenSplice
+    {
+        size_t first;
+        size_t removed;
+        size_t inserted;
+    };
+
+    // Lexes a source into compact tokens and keeps the source alive for them.
+    // Rows and columns are looked up from a line index when asked for.
+    // The source, tokens and line index are gap buffers with the gap at the
+    // last edit. Offsets behind it count from the end of the source, so an
+    // edit never has to move the tokens that follow it.
+    class TokenBuffer
+    {
+    public:
+        class Iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = CompactToken;
+            using difference_type = std::ptrdiff_t;
+
+            Iterator() = default;
+
+            Iterator(const TokenBuffer* buffer, size_t index) : buffer(buffer), index(index)
+            {
+            }
+
+            CompactToken operator*() const
+            {
+                return (*buffer)[index];
+            }
+
+            Iterator& operator++()
+            {
+                index++;
+                return *this;
+            }
+
+            Iterator operator++(int)
+            {
+                Iterator it = *this;
+                index++;
+                return it;
+            }
+
+            bool operator==(const Iterator& o) const
+            {
+                return index == o.index;
+            }
+
+        private:
+            const TokenBuffer* buffer = nullptr;
+            size_t index = 0;
+        };
+
+        explicit TokenBuffer(std::string source);
+
+        // Moves the gap of the source to its end, which costs the characters
+        // after the last edit. Not safe to call from several threads at once.
+        std::string_view Source() const
+        {
+            text.MoveGap(text.size());
+            return std::string_view(text.Before().data(), text.size());
+        }
+
+        size_t size() const
+        {
+            return tokens.size();
+        }
+
+        bool empty() const
+        {
+            return tokens.empty();
+        }
+
+        CompactToken operator[](size_t index) const
+        {
+            CompactToken token = tokens[index];
+            if (index >= tokens.Gap()) {
+                token.offset = static_cast<uint32_t>(text.size() - token.offset);
+            }
+            return token;
+        }
+
+        Iterator begin() const
+        {
+            return Iterator(this, 0);
+        }
+
+        Iterator end() const
+        {
+            return Iterator(this, size());
+        }
+
+        // tokens never straddle the gap of the source
+        std::string_view Text(const CompactToken& token) const
+        {
+            return std::string_view(text.Data(token.offset), token.length);
+        }
+
+        SourcePosition Position(const CompactToken& token) const;
+
+        SourcePosition Position(size_t offset) const;
+
+        // the token as LexText would have returned it
+        Token Expand(const CompactToken& token) const;
+
+        // Applies an edit to the source and lexes again from the token before
+        // it, up to the first token that starts where an old one did after the
+        // edit. Costs the changed tokens plus the distance the gaps move from
+        // the previous edit. Leaves the buffer as it was when the edited source
+        // does not lex.
+        TokenSplice Edit(const TextEdit& edit);
+
+        size_t SizeInBytes() const
+        {
+            return text.SizeInBytes() + tokens.SizeInBytes() + lines.SizeInBytes();
+        }
+
+    private:
+        // line start at index, counted from the start
+        uint32_t LineAt(size_t index) const
+        {
+            const uint32_t line = lines[index];
+            return index >= lines.Gap() ? static_cast<uint32_t>(text.size() - line) : line;
+        }
+
+        mutable GapBuffer<char> text;
+        GapBuffer<CompactToken> tokens;
+        GapBuffer<uint32_t> lines; // offsets lines start at
+    };
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <stdexcept>
+
+#include "types.hh"
+#include "value.hh"
+
+namespace theatre {
+
+using ArgumentError = std::runtime_error;
+
+// Arguments of a hook call, a view straight onto the top of the stack.
+// args[0] is the top of the stack, the value pushed last.
+class HookArgs
+{
+public:
+    HookArgs() = default;
+
+    // slots in stack order, the top of the stack last
+    explicit HookArgs(std::span<const Value> slots) : slots(slots)
+    {
+    }
+
+    size_t size() const {
+        return slots.size();
+    }
+
+    bool empty() const {
+        return slots.empty();
+    }
+
+    const Value& operator[](size_t index) const {
+        return slots[slots.size() - 1 - index];
+    }
+
+    // a copy of args[index] as hooks took it before they got Values
+    Any ToAny(size_t index) const {
+        return (*this)[index].ToAny();
+    }
+
+    auto begin() const {
+        return slots.rbegin();
+    }
+
+    auto end() const {
+        return slots.rend();
+    }
+
+    // all but the first count arguments
+    HookArgs Skip(size_t count) const {
+        return HookArgs(slots.first(slots.size() - count));
+    }
+
+private:
+    std::span<const Value> slots;
+};
+
+constexpr const char* TypeName(AnyType type) {
+    switch (type) {
+        case AnyType::INT: return "int";
+        case AnyType::FLOAT: return "float";
+        case AnyType::BOOL: return "bool";
+        case AnyType::STRING: return "string";
+        default: return "mono";
+    }
+}
+
+// Type a native parameter expects, MONO accepts anything.
+template <typename T>
+constexpr AnyType ParamType() {
+    if constexpr (std::is_same_v<T, int>) {
+        return AnyType::INT;
+    } else if constexpr (std::is_same_v<T, float>) {
+        return AnyType::FLOAT;
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return AnyType::BOOL;
+    } else if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+        return AnyType::STRING;
+    } else {
+        static_assert(std::is_same_v<T, Value> || std::is_same_v<T, Any>,
+                      "Natives take int, float, bool, strings, Value or Any");
+        return AnyType::MONO;
+    }
+}
+
+// ints are promoted to floats like in arithmetic
+constexpr bool Accepts(AnyType param, AnyType arg) {
+    return param == AnyType::MONO || param == arg
+        || (param == AnyType::FLOAT && arg == AnyType::INT);
+}
+
+// kept out of line so the unboxing around it stays small enough to inline
+[[noreturn]] void ThrowArgumentType(const std::string& name, size_t index,
+                                    AnyType expected, AnyType actual);
+
+template <typename T>
+T Unbox(const std::string& name, const Value& value, size_t index) {
+    constexpr AnyType type = ParamType<T>();
+    if (!Accepts(type, value.Type())) {
+        ThrowArgumentType(name, index, type, value.Type());
+    }
+    if constexpr (std::is_same_v<T, int>) {
+        return value.AsInt();
+    } else if constexpr (std::is_same_v<T, float>) {
+        return value.Number<float>();
+    } else if constexpr (std::is_same_v<T, bool>) {
+        return value.AsBool();
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+        return value.AsString();
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return std::string(value.AsString());
+    } else if constexpr (std::is_same_v<T, Any>) {
+        return value.ToAny();
+    } else {
+        return value;
+    }
+}
+
+template <typename T>
+Value Box(T&& result) {
+    using R = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<R, int>) {
+        return Value::Int(result);
+    } else if constexpr (std::is_same_v<R, float>) {
+        return Value::Float(result);
+    } else if constexpr (std::is_same_v<R, bool>) {
+        return Value::Bool(result);
+    } else if constexpr (std::is_same_v<R, std::string> || std::is_same_v<R, std::string_view>) {
+        return Value::String(result);
+    } else if constexpr (std::is_same_v<R, Any>) {
+        return Value(result);
+    } else {
+        static_assert(std::is_same_v<R, Value>, "Natives return int, float, bool, strings, Value or Any");
+        return std::forward<T>(result);
+    }
+}
+
+// Plain function pointer a native is stored as, cast back by its trampoline.
+using NativeTarget = void (*)();
+using NativeFunc = Value (*)(NativeTarget target, const std::string& name, HookArgs args);
+
+// Unboxes args[i] into parameter i, calls the function and boxes the result.
+template <typename R, typename... Args>
+Value NativeCall(NativeTarget target, const std::string& name, HookArgs args) {
+    const auto fn = reinterpret_cast<R (*)(Args...)>(target);
+    return [&]<size_t... I>(std::index_sequence<I...>) -> Value {
+        if constexpr (std::is_void_v<R>) {
+            fn(Unbox<std::remove_cvref_t<Args>>(name, args[I], I)...);
+            return Value();
+        } else {
+            return Box(fn(Unbox<std::remove_cvref_t<Args>>(name, args[I], I)...));
+        }
+    }(std::index_sequence_for<Args...>{});
+}
+
+};
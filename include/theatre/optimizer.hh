@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include <magic_enum.hpp>
+
+#include "bytecode.hh"
+
+namespace theatre {
+
+struct OptimizeOptions
+{
+    // evaluate arithmetic on constants ahead of time
+    bool foldConstants = true;
+    // drop identity arithmetic like PUSH 0 / ADD on operands of a known type
+    bool removeNoops = true;
+    // PUSH <const> followed by arithmetic becomes one <op>_CONST instruction,
+    // PUSH followed by CALL becomes PUSH_CALL
+    bool fuse = true;
+};
+
+// Peephole pass over parsed TASM. The optimized program leaves the same
+// values on the stack, produces the same output and raises the same errors.
+std::vector<Command> Optimize(const std::vector<Command>& program,
+                              const OptimizeOptions& options = {});
+
+struct OpcodePair
+{
+    Opcode first;
+    Opcode second;
+    size_t count;
+};
+
+// Counts adjacent opcode pairs over a corpus of programs. Feeding it
+// optimized programs shows which sequences are left to fuse.
+class PairProfile
+{
+public:
+    PairProfile();
+
+    void Add(const std::vector<Command>& program);
+
+    size_t Count(Opcode first, Opcode second) const;
+
+    size_t Total() const {
+        return total;
+    }
+
+    // most frequent first
+    std::vector<OpcodePair> MostFrequent(size_t limit = 10) const;
+
+    friend std::ostream& operator<<(std::ostream& os, const PairProfile& profile);
+
+private:
+    static constexpr size_t OPCODES = magic_enum::enum_count<Opcode>();
+
+    std::vector<size_t> counts; // OPCODES x OPCODES
+    size_t total = 0;
+
+    static size_t Index(Opcode first, Opcode second) {
+        return static_cast<size_t>(first) * OPCODES + static_cast<size_t>(second);
+    }
+};
+
+};
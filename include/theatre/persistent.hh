@@ -0,0 +1,126 @@
+#pragma once
+
+#include <memory>
+#include <iterator>
+#include <cstddef>
+#include <utility>
+
+namespace theatre {
+
+// Immutable singly linked list with structurally shared tails.
+// Copying a list is a pointer copy, so values holding one stay cheap to copy.
+// Push and Pop only replace the head of this handle; other handles that share
+// the old nodes are never affected.
+template <typename T>
+class PersistentList
+{
+    struct Node {
+        T value;
+        std::shared_ptr<Node> next;
+        size_t size;
+    };
+
+public:
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        Iterator(const Node* node = nullptr) : node(node) {}
+
+        reference operator*() const { return node->value; }
+        pointer operator->() const { return &node->value; }
+
+        Iterator& operator++() {
+            node = node->next.get();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator it = *this;
+            ++(*this);
+            return it;
+        }
+
+        bool operator==(const Iterator& o) const { return node == o.node; }
+
+    private:
+        const Node* node;
+    };
+
+    PersistentList() = default;
+    PersistentList(const PersistentList& o) = default;
+    PersistentList(PersistentList&& o) noexcept = default;
+
+    PersistentList& operator=(PersistentList o) noexcept {
+        std::swap(head, o.head);
+        return *this;
+    }
+
+    ~PersistentList() {
+        Clear();
+    }
+
+    bool IsEmpty() const {
+        return head == nullptr;
+    }
+
+    size_t Size() const {
+        return head ? head->size : 0;
+    }
+
+    const T& Front() const {
+        return head->value;
+    }
+
+    void Push(T value) {
+        const size_t size = Size() + 1;
+        head = std::make_shared<Node>(Node{ std::move(value), std::move(head), size });
+    }
+
+    T Pop() {
+        if (head.use_count() != 1) {
+            T value = head->value;
+            Drop();
+            return value;
+        }
+        // nobody else sees this node, so its value can be moved out
+        T value = std::move(head->value);
+        Drop();
+        return value;
+    }
+
+    // pops without handing out the value
+    void Drop() {
+        std::shared_ptr<Node> next = head->next;
+        head = std::move(next);
+    }
+
+    // Unlinks unshared nodes one by one, long lists would otherwise
+    // overflow the call stack with recursive destructors.
+    void Clear() {
+        while (head && head.use_count() == 1) {
+            std::shared_ptr<Node> next = std::move(head->next);
+            head = std::move(next);
+        }
+        head.reset();
+    }
+
+    // true when both handles are at the same node, e.g. one is an unchanged copy of the other
+    bool Shares(const PersistentList& o) const {
+        return head == o.head;
+    }
+
+    // iterates from the most recently pushed value
+    Iterator begin() const { return Iterator(head.get()); }
+    Iterator end() const { return Iterator(); }
+
+private:
+    std::shared_ptr<Node> head;
+};
+
+};
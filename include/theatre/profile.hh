@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+#include <magic_enum.hpp>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define THEATRE_HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define THEATRE_HAS_RDTSC 1
+#else
+#define THEATRE_HAS_RDTSC 0
+#endif
+
+#include "bytecode.hh"
+#include "strings.hh"
+
+// Builds without profiling compile the probes out of the dispatch loop.
+#ifndef THEATRE_PROFILING
+#define THEATRE_PROFILING 1
+#endif
+
+namespace theatre {
+
+// Cycle counter where there is one, steady clock nanoseconds elsewhere.
+inline uint64_t ReadTicks() {
+#if THEATRE_HAS_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline uint64_t ReadNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct OpcodeStats
+{
+    uint64_t count = 0;
+    uint64_t ticks = 0; // time until the next instruction started
+};
+
+// Bucket i counts latencies below 2^i nanoseconds that did not fit bucket i - 1.
+class LatencyHistogram
+{
+public:
+    static constexpr size_t BUCKETS = 40;
+
+    void Add(uint64_t nanos);
+
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t Count() const {
+        return count;
+    }
+
+    std::span<const uint64_t> Buckets() const {
+        return buckets;
+    }
+
+    // upper bound of the bucket holding the given fraction of samples, 0.5 for the median
+    uint64_t Percentile(double fraction) const;
+
+private:
+    std::array<uint64_t, BUCKETS> buckets {};
+    uint64_t count = 0;
+};
+
+struct HookStats
+{
+    uint64_t calls = 0;
+    uint64_t nanos = 0;
+    LatencyHistogram latency;
+};
+
+// Where the programs run on a machine spend their time, per TASM opcode and
+// per hook. Collected by Run() while profiling is enabled on the machine.
+class Profile
+{
+public:
+    static constexpr size_t OPCODES = magic_enum::enum_count<Opcode>();
+
+    const OpcodeStats& Of(Opcode code) const {
+        return opcodes[static_cast<size_t>(code)];
+    }
+
+    // nullptr when the hook was never called
+    const HookStats* OfHook(std::string_view name) const;
+
+    const std::map<std::string, HookStats, std::less<>>& Hooks() const {
+        return hooks;
+    }
+
+    void Clear();
+
+    void WriteJson(std::ostream& os) const;
+
+    friend std::ostream& operator<<(std::ostream& os, const Profile& profile);
+
+private:
+    friend class ProfileProbe;
+
+    std::array<OpcodeStats, OPCODES> opcodes {};
+    std::map<std::string, HookStats, std::less<>> hooks;
+};
+
+// Probe policies the dispatch loop is instantiated with.
+// NoProbe does nothing and compiles away entirely.
+struct NoProbe
+{
+    void Start() {}
+    void Retire(Opcode) {}
+    uint64_t BeginCall() { return 0; }
+    void EndCall(uint32_t, uint64_t) {}
+};
+
+// Counts into locals while the program runs and adds them to the profile
+// when destroyed, hooks are told apart by their import index until then.
+class ProfileProbe
+{
+public:
+    ProfileProbe(Profile& profile, std::span<const Symbol> imports)
+        : profile(profile), imports(imports), calls(imports.size())
+    {
+    }
+
+    ProfileProbe(const ProfileProbe&) = delete;
+    ProfileProbe& operator=(const ProfileProbe&) = delete;
+
+    ~ProfileProbe();
+
+    void Start() {
+        last = ReadTicks();
+    }
+
+    void Retire(Opcode code) {
+        const uint64_t now = ReadTicks();
+        OpcodeStats& stats = opcodes[static_cast<size_t>(code)];
+        stats.count++;
+        stats.ticks += now - last;
+        last = now;
+    }
+
+    uint64_t BeginCall() {
+        return ReadNanos();
+    }
+
+    void EndCall(uint32_t import, uint64_t start) {
+        const uint64_t nanos = ReadNanos() - start;
+        HookStats& stats = calls[import];
+        stats.calls++;
+        stats.nanos += nanos;
+        stats.latency.Add(nanos);
+    }
+
+private:
+    Profile& profile;
+    std::span<const Symbol> imports;
+    std::array<OpcodeStats, Profile::OPCODES> opcodes {};
+    std::vector<HookStats> calls; // indexed like the imports
+    uint64_t last = 0;
+};
+
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+namespace theatre {
+
+// Character class kernels the lexer skips runs of characters with.
+// Each returns the first character in [begin, end) outside of its class.
+enum class ScanLevel
+{
+    SCALAR,
+    SSE2, // 16 bytes at a time
+    AVX2, // 32 bytes at a time
+};
+
+struct ScanKernels
+{
+    using Kernel = const char* (*)(const char* begin, const char* end);
+
+    ScanLevel level;
+    Kernel skipSpace;  // ' ', \t, \n, \v, \f and \r
+    Kernel skipIdent;  // letters, digits and underscores
+    Kernel skipDigits;
+
+    // Picked once for the CPU the program runs on.
+    static const ScanKernels& Best();
+
+    // nullptr when this build or CPU cannot run the level
+    static const ScanKernels* Get(ScanLevel level);
+};
+
+};
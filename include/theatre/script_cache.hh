@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "bytecode.hh"
+
+namespace theatre {
+
+constexpr size_t DEFAULT_SCRIPT_CACHE_CAPACITY = 16 * 1024 * 1024; // bytes
+
+// TASM text parsed, optimized and assembled, ready to be run.
+struct CompiledScript
+{
+    std::string source;
+    bool optimized;
+    Bytecode bytecode;
+
+    size_t SizeInBytes() const {
+        return sizeof(CompiledScript) + source.size() + bytecode.SizeInBytes();
+    }
+};
+
+std::shared_ptr<CompiledScript> Compile(std::string_view script, bool optimize = true);
+
+// Least recently used cache of compiled scripts, keyed by a hash of their
+// text. Running a script quickens its bytecode in place, so like Run() a
+// cache should not be used by several threads at once.
+class ScriptCache
+{
+public:
+    explicit ScriptCache(size_t capacity = DEFAULT_SCRIPT_CACHE_CAPACITY) : capacity(capacity)
+    {
+    }
+
+    // Compiles the script on a miss. Scripts larger than the capacity
+    // are compiled but not kept.
+    std::shared_ptr<CompiledScript> Get(std::string_view script, bool optimize = true);
+
+    size_t Hits() const {
+        return hits;
+    }
+
+    size_t Misses() const {
+        return misses;
+    }
+
+    size_t Size() const {
+        return entries.size();
+    }
+
+    size_t SizeInBytes() const {
+        return size;
+    }
+
+    size_t GetCapacity() const {
+        return capacity;
+    }
+
+    // evicts right away when the cache is over the new capacity
+    void SetCapacity(size_t bytes);
+
+    void Clear();
+
+    // the cache RunScript uses on this thread
+    static ScriptCache& ForThread();
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        std::shared_ptr<CompiledScript> script;
+    };
+
+    size_t capacity;
+    size_t size = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+
+    void Evict(size_t target);
+};
+
+};
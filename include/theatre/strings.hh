@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace theatre {
+
+class StringTable;
+
+// Immutable string payload of a Value. Runtime strings are reference counted,
+// interned ones belong to a table. Strings interned with StringTable::Intern
+// are immortal and never touch their count, the ones shared with
+// StringTable::Share are counted and leave their table with the last
+// reference.
+// NOTE: the count of runtime strings is not atomic, they belong to a single
+// thread. Interned strings are shared between threads and count atomically.
+struct StringObject
+{
+    static constexpr uint32_t IMMORTAL = std::numeric_limits<uint32_t>::max();
+
+    uint32_t refs;
+    uint32_t length;
+    StringTable* table; // set while interned
+
+    const char* Chars() const {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+
+    std::string_view View() const {
+        return std::string_view(Chars(), length);
+    }
+
+    bool IsInterned() const {
+        return table != nullptr;
+    }
+
+    void Retain();
+    // frees the string, or removes it from its table, with the last reference
+    void Release();
+
+    static StringObject* Create(std::string_view text);
+    static void Destroy(StringObject* str);
+};
+
+// Interned strings are compared by pointer
+using Symbol = const StringObject*;
+
+// Keeps one copy of every string interned into it. Intern makes the copy
+// immortal, it lives as long as the table does. Share counts the callers
+// holding it instead and drops the copy once the last one released it, so
+// literals of programs that are gone do not pile up. Safe to share between
+// threads.
+class StringTable
+{
+public:
+    StringTable() = default;
+    StringTable(const StringTable&) = delete;
+    StringTable& operator=(const StringTable&) = delete;
+    ~StringTable();
+
+    Symbol Intern(std::string_view text);
+
+    // The copy of text with one more reference, the caller releases it.
+    // Interning the same text later makes it immortal.
+    StringObject* Share(std::string_view text);
+
+    // nullptr when the text was never interned
+    Symbol Find(std::string_view text) const;
+
+    size_t Size() const;
+
+    // Process wide table literals and hook names are interned into.
+    static StringTable& Global();
+
+private:
+    friend struct StringObject;
+
+    // drops the last reference of a shared string unless Share handed it out again
+    void Release(StringObject* str);
+
+    mutable std::mutex mutex;
+    // keys view the characters of their own string
+    std::unordered_map<std::string_view, StringObject*> strings;
+};
+
+inline void StringObject::Retain() {
+    if (!table) {
+        refs++;
+        return;
+    }
+    std::atomic_ref<uint32_t> count(refs);
+    uint32_t current = count.load(std::memory_order_relaxed);
+    while (current != IMMORTAL
+           && !count.compare_exchange_weak(current, current + 1, std::memory_order_relaxed)) {
+    }
+}
+
+inline void StringObject::Release() {
+    if (!table) {
+        if (--refs == 0) {
+            Destroy(this);
+        }
+        return;
+    }
+    // only the last reference needs the table, the others just count down
+    std::atomic_ref<uint32_t> count(refs);
+    uint32_t current = count.load(std::memory_order_relaxed);
+    while (current != IMMORTAL && current > 1) {
+        if (count.compare_exchange_weak(current, current - 1, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+    if (current != IMMORTAL) {
+        table->Release(this);
+    }
+}
+
+};
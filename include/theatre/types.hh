@@ -1,8 +1,10 @@
 #pragma once
 
 #include <array>
+#include <charconv>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <stdexcept>
 #include <format>
@@ -39,13 +41,22 @@ public:
     // Additional constructors for convenience
     Any(const char* value) : Any(std::string(value)) {}
 
-    static Any Parse(const std::string& text) {
+    static Any Parse(std::string_view text) {
         if (text.empty()) {
             return Any();
         } else if (text.find_first_not_of("0123456789") == std::string_view::npos) {
-            return Any(std::stoi(text));
+            int value = 0;
+            if (std::from_chars(text.data(), text.data() + text.size(), value).ec != std::errc()) {
+                throw std::out_of_range(std::format("Integer out of range: {}", text));
+            }
+            return Any(value);
         } else if (text.find('.') != std::string_view::npos) {
-            return Any(std::stof(text));
+            float value = 0.0f;
+            if (std::from_chars(text.data(), text.data() + text.size(), value).ec != std::errc()) {
+                // leading signs, spaces and the like
+                return Any(std::stof(std::string(text)));
+            }
+            return Any(value);
         } else if (text == "true" || text == "false") {
             return Any(text == "true");
         } else {
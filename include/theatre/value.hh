@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <bit>
+#include <string>
+#include <string_view>
+#include <iostream>
+
+#include "types.hh"
+#include "strings.hh"
+
+namespace theatre {
+
+// 8-byte tagged counterpart of Any that the virtual machine computes with.
+// The AnyType lives in the low 3 bits. Ints, floats and bools are stored in
+// the upper 32 bits, strings are a pointer to a StringObject, which is
+// always aligned to at least 8 bytes so its low bits are free for the tag.
+// Copying an immortal interned string only checks its count.
+class Value
+{
+public:
+    constexpr Value() : bits(static_cast<uint64_t>(AnyType::MONO)) {}
+
+    explicit Value(const Any& any);
+
+    static Value Int(int value) {
+        return Value(static_cast<uint64_t>(static_cast<uint32_t>(value)) << 32, AnyType::INT);
+    }
+
+    static Value Float(float value) {
+        return Value(static_cast<uint64_t>(std::bit_cast<uint32_t>(value)) << 32, AnyType::FLOAT);
+    }
+
+    static Value Bool(bool value) {
+        return Value(static_cast<uint64_t>(value) << 32, AnyType::BOOL);
+    }
+
+    // reference counted runtime string
+    static Value String(std::string_view text);
+
+    static Value Interned(std::string_view text, StringTable& table = StringTable::Global()) {
+        return FromSymbol(table.Intern(text));
+    }
+
+    // interned string that leaves the table along with the last value holding it
+    static Value Shared(std::string_view text, StringTable& table = StringTable::Global()) {
+        return Value(reinterpret_cast<uintptr_t>(table.Share(text)), AnyType::STRING);
+    }
+
+    static Value FromSymbol(Symbol symbol) {
+        return Value(reinterpret_cast<uintptr_t>(symbol), AnyType::STRING);
+    }
+
+    Value(const Value& o) : bits(o.bits) {
+        Retain();
+    }
+
+    Value(Value&& o) noexcept : bits(o.bits) {
+        o.bits = static_cast<uint64_t>(AnyType::MONO);
+    }
+
+    Value& operator=(const Value& o) {
+        if (this != &o) {
+            o.Retain();
+            Release();
+            bits = o.bits;
+        }
+        return *this;
+    }
+
+    Value& operator=(Value&& o) noexcept {
+        if (this != &o) {
+            Release();
+            bits = o.bits;
+            o.bits = static_cast<uint64_t>(AnyType::MONO);
+        }
+        return *this;
+    }
+
+    ~Value() {
+        Release();
+    }
+
+    constexpr AnyType Type() const {
+        return static_cast<AnyType>(bits & TAG_MASK);
+    }
+
+    constexpr bool IsType(AnyType type) const {
+        return Type() == type;
+    }
+
+    constexpr bool IsMono() const { return IsType(AnyType::MONO); }
+    constexpr bool IsInt() const { return IsType(AnyType::INT); }
+    constexpr bool IsFloat() const { return IsType(AnyType::FLOAT); }
+    constexpr bool IsBool() const { return IsType(AnyType::BOOL); }
+    constexpr bool IsString() const { return IsType(AnyType::STRING); }
+
+    // unchecked accessors, check the type first
+    constexpr int AsInt() const {
+        return static_cast<int>(static_cast<uint32_t>(bits >> 32));
+    }
+
+    constexpr float AsFloat() const {
+        return std::bit_cast<float>(static_cast<uint32_t>(bits >> 32));
+    }
+
+    constexpr bool AsBool() const {
+        return (bits >> 32) != 0;
+    }
+
+    std::string_view AsString() const {
+        return Object()->View();
+    }
+
+    // nullptr unless this is an interned string
+    Symbol AsSymbol() const {
+        return IsString() && Object()->IsInterned() ? Object() : nullptr;
+    }
+
+    // Numeric value with the same conversions as Any::Value<T>()
+    template <typename T>
+    T Number() const {
+        if (IsFloat()) {
+            return static_cast<T>(AsFloat());
+        } else if (IsInt()) {
+            return static_cast<T>(AsInt());
+        }
+        ThrowNotNumeric();
+    }
+
+    Any ToAny() const;
+
+    // Same as ToAny().Extract<T>(), hooks written against Any keep working.
+    template <typename T>
+    T Extract() const {
+        return ToAny().Extract<T>();
+    }
+
+    std::string ToString() const;
+    const char* GetTypeName() const;
+
+    // Same payload, floats compare by bits and strings by content.
+    bool Identical(const Value& o) const;
+    size_t Hash() const;
+
+    uint64_t Bits() const {
+        return bits;
+    }
+
+    friend Value operator+(const Value& a, const Value& b);
+    friend Value operator-(const Value& a, const Value& b);
+    friend Value operator*(const Value& a, const Value& b);
+    friend Value operator/(const Value& a, const Value& b);
+
+    friend std::ostream& operator<<(std::ostream& os, const Value& value);
+
+private:
+    static constexpr uint64_t TAG_MASK = 0b111;
+
+    uint64_t bits;
+
+    Value(uint64_t payload, AnyType type)
+        : bits(payload | static_cast<uint64_t>(type))
+    {
+    }
+
+    StringObject* Object() const {
+        return reinterpret_cast<StringObject*>(bits & ~TAG_MASK);
+    }
+
+    void Retain() const {
+        if (IsString()) {
+            Object()->Retain();
+        }
+    }
+
+    void Release() {
+        if (IsString()) {
+            Object()->Release();
+        }
+    }
+
+    [[noreturn]] void ThrowNotNumeric() const;
+};
+
+static_assert(sizeof(Value) == 8, "Value should stay 8 bytes");
+
+};
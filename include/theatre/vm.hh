@@ -0,0 +1,302 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <format>
+#include <magic_enum.hpp>
+
+#include "types.hh"
+#include "value.hh"
+#include "persistent.hh"
+#include "bytecode.hh"
+#include "history.hh"
+#include "profile.hh"
+#include "native.hh"
+
+namespace theatre {
+
+// Virtual machine and its types' methods should be pure.
+// The exception is Run(), which executes a whole program in place.
+// Stack, history and hooks are structurally shared between copies,
+// so keeping older machines around (e.g. for undo) stays cheap.
+
+using ParseError = std::runtime_error;
+using VmError = std::runtime_error;
+
+// Labels-as-values let every handler jump straight to the next one,
+// other compilers get a plain switch loop.
+#if defined(__GNUC__) || defined(__clang__)
+#define THEATRE_THREADED_DISPATCH 1
+#else
+#define THEATRE_THREADED_DISPATCH 0
+#endif
+
+enum class DispatchMode
+{
+    SWITCH,
+    THREADED, // falls back to SWITCH when unsupported
+};
+
+constexpr DispatchMode DEFAULT_DISPATCH = THEATRE_THREADED_DISPATCH ? DispatchMode::THREADED
+                                                                    : DispatchMode::SWITCH;
+
+class VirtualMachine;
+class WorkingStack;
+
+struct HookContext {
+    VirtualMachine& vm;
+    HookArgs args; // only valid during the call
+    std::ostream& out;
+
+    HookContext(VirtualMachine& vm, HookArgs args, std::ostream& out)
+        : vm(vm), args(args), out(out)
+        {
+        }
+};
+
+using HookFunc = std::function<Any(HookContext&&)>;
+struct Hook {
+    int argc; // -1 for infinite
+    HookFunc func;
+    std::string name;
+
+    // set for functions registered with Bind, called instead of func
+    NativeFunc native = nullptr;
+    NativeTarget target = nullptr;
+    std::vector<AnyType> params;
+
+    Any Call(VirtualMachine* vm, HookArgs args) const;
+
+    // Parameter i is unboxed from args[i], so the first parameter is the top
+    // of the stack.
+    template <typename R, typename... Args>
+    static Hook Native(const std::string& name, R (*fn)(Args...)) {
+        return Hook{ sizeof...(Args), nullptr, name, &NativeCall<R, Args...>,
+                     reinterpret_cast<NativeTarget>(fn),
+                     { ParamType<std::remove_cvref_t<Args>>()... } };
+    }
+};
+
+// Hooks by name, in a dense table. A registry is meant to be built once and
+// then shared between machines as a std::shared_ptr<const HookRegistry>,
+// machines only ever add hooks to an overlay of their own.
+class HookRegistry
+{
+public:
+    // re-registering a name replaces the hook in its slot
+    void Register(Hook hook);
+
+    void Register(const std::string& name, HookFunc func, int paramCount = -1) {
+        Register(Hook{ paramCount, std::move(func), name, nullptr, nullptr, {} });
+    }
+
+    template <typename R, typename... Args>
+    void Bind(const std::string& name, R (*fn)(Args...)) {
+        Register(Hook::Native(name, fn));
+    }
+
+    // captureless lambdas
+    template <typename F>
+        requires std::is_empty_v<F> && requires (F fn) { +fn; }
+    void Bind(const std::string& name, F fn) {
+        Bind(name, +fn);
+    }
+
+    // nullptr when no hook is registered under the name
+    const Hook* Find(Symbol name) const {
+        const auto it = indices.find(name);
+        return it == indices.end() ? nullptr : &slots[it->second];
+    }
+
+    size_t Size() const {
+        return slots.size();
+    }
+
+private:
+    std::vector<Hook> slots;
+    std::unordered_map<Symbol, uint32_t> indices; // names interned in the global table
+};
+
+class VirtualMachine
+{
+public:
+    VirtualMachine(const std::string& name = "", std::ostream& outStream = std::cout)
+        : name(name), outStream(&outStream)
+    {
+    }
+
+    // Uses the standard library, shared with every other machine.
+    void Init() {
+        SetRegistry(StandardLibrary());
+    }
+
+    // print, println and throw. Host registries start from a copy of it.
+    static const std::shared_ptr<const HookRegistry>& StandardLibrary();
+
+    // Hooks registered on this machine shadow the ones in the registry.
+    void SetRegistry(std::shared_ptr<const HookRegistry> base) {
+        registry = std::move(base);
+    }
+
+    // Runs every instruction of the program on this machine, mutating it in place.
+    // Arithmetic in the program is quickened into typed ops as it runs,
+    // so a program should not be run by several threads at once.
+    void Run(Bytecode& program, DispatchMode mode = DEFAULT_DISPATCH);
+
+    void Run(Bytecode&& program, DispatchMode mode = DEFAULT_DISPATCH) {
+        Run(program, mode);
+    }
+
+    void Run(const std::vector<Command>& program) {
+        Run(Assemble(program));
+    }
+
+    [[nodiscard]] VirtualMachine Execute(const Command& cmd) const;
+
+    bool IsStackEmpty() const {
+        return stack.IsEmpty();
+    }
+
+    void EnsureStackLength(int argc) const
+    {
+        if (static_cast<int>(stack.Size()) < argc) {
+            throw VmError(std::format("Stack underflow. Expected {} items but got {}.",
+                                      argc, stack.Size()));
+        }
+    }
+
+    [[nodiscard]] VirtualMachine PopStack(Any* outValue) const;
+    [[nodiscard]] VirtualMachine PushStack(const Any& value) const;
+
+    Any PeekStack() const {
+        if (IsStackEmpty()) {
+            throw VmError("Stack underflow");
+        }
+        return stack.Front().ToAny();
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const VirtualMachine& vm);
+
+    void Register(const std::string& name, HookFunc func, int paramCount = -1);
+
+    // Registers a plain function, see Hook::Native. Argument types are checked
+    // when a program is loaded wherever the values on the stack are known.
+    template <typename R, typename... Args>
+    void Bind(const std::string& name, R (*fn)(Args...)) {
+        Register(Hook::Native(name, fn));
+    }
+
+    // captureless lambdas
+    template <typename F>
+        requires std::is_empty_v<F> && requires (F fn) { +fn; }
+    void Bind(const std::string& name, F fn) {
+        Bind(name, +fn);
+    }
+
+    // The reference stays valid until the next Register on this machine.
+    const Hook& GetHook(const std::string& name) const {
+        const Hook* hook = FindHook(StringTable::Global().Find(name));
+        if (!hook) {
+            throw VmError(std::format("No external hook found with name: {}", name));
+        }
+        return *hook;
+    }
+
+    // Drops the recorded history, history is off unless enabled here.
+    void SetHistoryMode(HistoryMode mode, size_t capacity = DEFAULT_HISTORY_CAPACITY) {
+        history = History(mode, capacity);
+    }
+
+    const History& GetHistory() const {
+        return history;
+    }
+
+    // Counts and times the instructions Run() executes and the hooks it calls.
+    // Enabling starts a new profile, copies made afterwards add to the same one.
+    // Builds with THEATRE_PROFILING off never collect anything.
+    void SetProfiling(bool enabled) {
+        profile = enabled ? std::make_shared<Profile>() : nullptr;
+    }
+
+    // nullptr unless profiling
+    std::shared_ptr<const Profile> GetProfile() const {
+        return profile;
+    }
+
+    inline std::ostream& GetOutStream() {
+        return *outStream;
+    }
+
+private:
+
+    std::string name;
+    History history{};
+    std::shared_ptr<Profile> profile;
+    PersistentList<Value> stack{}; // front is the top of the stack
+    std::shared_ptr<const HookRegistry> registry;
+    std::shared_ptr<HookRegistry> hooks; // registered on this machine, copied on write when shared
+    std::ostream* outStream;
+
+    // executes on either the persistent stack or the working stack of Run()
+    template <typename Stack>
+    void Step(Stack& stack, const Command& cmd);
+
+    template <bool Threaded, typename Probe>
+    void Dispatch(Bytecode& program, WorkingStack& stack,
+                  const std::vector<Value>& operands,
+                  const std::vector<const Hook*>& links, Probe& probe);
+
+    template <typename Stack, typename F>
+    static void ApplyBinary(Stack& stack, F op);
+
+    template <typename Stack, typename F>
+    static void ApplyConstant(Stack& stack, const Value& constant, F op);
+
+    // nullptr when no hook is registered under the name
+    const Hook* FindHook(Symbol name) const {
+        if (!name) {
+            return nullptr;
+        }
+        const Hook* hook = hooks ? hooks->Find(name) : nullptr;
+        if (!hook && registry) {
+            hook = registry->Find(name);
+        }
+        return hook;
+    }
+
+    void Register(Hook hook);
+
+    // Resolves the imports of the program against the hooks of this machine,
+    // reusing the program's linkage when it was made for the same hooks.
+    std::shared_ptr<const Linkage> Link(Bytecode& program) const;
+
+    // argc of -1 takes the arity of the hook
+    template <typename Stack>
+    void CallHook(Stack& stack, const Value& name, int argc = -1);
+
+    template <typename Stack>
+    void Invoke(Stack& stack, const Hook& hook, int argc = -1);
+
+    static Any Throw(HookContext&& ctx);
+    static void _BasePrint(HookContext& ctx);
+    static Any Print(HookContext&& ctx);
+    static Any PrintLn(HookContext&& ctx);
+    static std::string FormatWithVector(const std::string& format, HookArgs args);
+};
+
+std::optional<Command> ParseLine(const std::string_view& line);
+
+// every command in a TASM script, blank lines skipped
+std::vector<Command> ParseScript(std::string_view script);
+
+void RunRepl();
+
+};
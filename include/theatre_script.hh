@@ -4,12 +4,21 @@
 #include <iostream>
 
 #include "theatre/types.hh"
+#include "theatre/vm.hh"
+#include "theatre/optimizer.hh"
+#include "theatre/script_cache.hh"
+#include "theatre/bytecode_file.hh"
 
 namespace theatre {
 
 constexpr bool VERBOSE_LOGGING = false;
 
 class Any;
-Any RunScript(const std::string_view& script, std::ostream& target = std::cout);
+// optimize runs the peephole optimizer over the script before assembling it,
+// scripts seen before on this thread are taken from ScriptCache::ForThread()
+Any RunScript(const std::string_view& script, std::ostream& target = std::cout,
+              bool optimize = true);
+
+Any RunScript(CompiledScript& script, std::ostream& target = std::cout);
 
 };
\ No newline at end of file
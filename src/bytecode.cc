@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <format>
+
+#include "theatre/bytecode.hh"
+
+namespace theatre {
+
+uint32_t ConstantPool::Add(const Value& value) {
+    const auto [it, inserted] = indices.try_emplace(value, static_cast<uint32_t>(values.size()));
+    if (inserted) {
+        values.emplace_back(value);
+    }
+    return it->second;
+}
+
+size_t ConstantPool::SizeInBytes() const {
+    size_t size = values.size() * sizeof(Value);
+    for (const Value& value: values) {
+        if (value.IsString()) {
+            size += sizeof(StringObject) + value.AsString().size() + 1;
+        }
+    }
+    return size;
+}
+
+static uint32_t AddConstant(Bytecode& program, StringTable& strings, const Any& value) {
+    // programs share one copy of every literal, it leaves the table along
+    // with the last program or value using it
+    const Value constant = value.IsType<std::string>()
+        ? Value::Shared(std::get<std::string>(value), strings)
+        : Value(value);
+    const uint32_t index = program.constants.Add(constant);
+    if (index > MAX_OPERAND) {
+        throw AssembleError(std::format("Constant pool overflow, more than {} constants.", MAX_OPERAND + 1));
+    }
+    return index;
+}
+
+static Instruction AssembleConstant(Op op, Bytecode& program, StringTable& strings,
+                                   const Any& value) {
+    return Encode(op, AddConstant(program, strings, value));
+}
+
+static uint32_t AddImport(Bytecode& program, StringTable& strings, const Any& name) {
+    if (!name.IsType<std::string>()) {
+        throw AssembleError(std::format("Expected type string, but got {}", name.ToString()));
+    }
+    const Symbol symbol = strings.Intern(std::get<std::string>(name));
+    // programs only call a handful of different hooks
+    const auto it = std::find(program.imports.begin(), program.imports.end(), symbol);
+    if (it != program.imports.end()) {
+        return static_cast<uint32_t>(it - program.imports.begin());
+    }
+    if (program.imports.size() > MAX_PAIR_OPERAND) {
+        throw AssembleError(std::format("Import table overflow, more than {} hooks.", MAX_PAIR_OPERAND + 1));
+    }
+    program.imports.emplace_back(symbol);
+    return static_cast<uint32_t>(program.imports.size() - 1);
+}
+
+static Instruction AssembleCall(Bytecode& program, StringTable& strings, const Command& cmd) {
+    const uint32_t hook = AddImport(program, strings, cmd.value);
+    if (cmd.operand.IsMono()) {
+        return EncodePair(Op::CALL, hook, NO_ARGC);
+    }
+    if (!cmd.operand.IsType<int>() || cmd.operand.Extract<int>() < 0
+                                   || cmd.operand.Extract<int>() >= static_cast<int>(NO_ARGC)) {
+        throw AssembleError(std::format("Expected an argument count, but got {}", cmd.operand.ToString()));
+    }
+    return EncodePair(Op::CALL, hook, cmd.operand.Extract<int>());
+}
+
+static void AssemblePushCall(Bytecode& program, StringTable& strings, const Command& cmd) {
+    const uint32_t value = AddConstant(program, strings, cmd.value);
+    const uint32_t hook = AddImport(program, strings, cmd.operand);
+    if (value <= MAX_PAIR_OPERAND && hook <= MAX_PAIR_OPERAND) {
+        program.code.emplace_back(EncodePair(Op::PUSH_CALL, value, hook));
+    } else {
+        program.code.emplace_back(Encode(Op::PUSH_CONST, value));
+        program.code.emplace_back(EncodePair(Op::CALL, hook, NO_ARGC));
+    }
+}
+
+static Instruction AssembleCommand(Bytecode& program, StringTable& strings, const Command& cmd) {
+    switch (cmd.code) {
+        case Opcode::PUSH: {
+            if (cmd.value.IsMono()) {
+                return Encode(Op::PUSH_MONO);
+            }
+            if (cmd.value.IsType<int>()) {
+                const int value = cmd.value.Extract<int>();
+                if (value >= MIN_IMMEDIATE && value <= MAX_IMMEDIATE) {
+                    return EncodeImmediate(Op::PUSH_INT, value);
+                }
+            }
+            return AssembleConstant(Op::PUSH_CONST, program, strings, cmd.value);
+        }
+        case Opcode::ADD: return Encode(Op::ADD);
+        case Opcode::SUB: return Encode(Op::SUB);
+        case Opcode::MUL: return Encode(Op::MUL);
+        case Opcode::DIV: return Encode(Op::DIV);
+        case Opcode::CALL: return AssembleCall(program, strings, cmd);
+        case Opcode::ADD_CONST: return AssembleConstant(Op::ADD_CONST, program, strings, cmd.value);
+        case Opcode::SUB_CONST: return AssembleConstant(Op::SUB_CONST, program, strings, cmd.value);
+        case Opcode::MUL_CONST: return AssembleConstant(Op::MUL_CONST, program, strings, cmd.value);
+        case Opcode::DIV_CONST: return AssembleConstant(Op::DIV_CONST, program, strings, cmd.value);
+        default: {
+            throw AssembleError(std::format("Opcode {} can not be assembled.",
+                                            magic_enum::enum_name<Opcode>(cmd.code)));
+        }
+    }
+}
+
+Bytecode Assemble(const std::vector<Command>& program, StringTable& strings) {
+    Bytecode bytecode;
+    bytecode.code.reserve(program.size());
+    for (const Command& cmd: program) {
+        if (cmd.code == Opcode::PUSH_CALL) {
+            AssemblePushCall(bytecode, strings, cmd);
+        } else {
+            bytecode.code.emplace_back(AssembleCommand(bytecode, strings, cmd));
+        }
+    }
+    return bytecode;
+}
+
+std::ostream& operator<<(std::ostream& os, const Bytecode& program) {
+    for (Instruction ins: program.code) {
+        const Op op = OpOf(ins);
+        os << magic_enum::enum_name<Op>(op);
+        switch (op) {
+            case Op::PUSH_INT:
+                os << " " << ImmediateOf(ins);
+                break;
+            case Op::CALL:
+                os << " @" << FirstOf(ins) << " (" << program.imports[FirstOf(ins)]->View() << ")";
+                if (SecondOf(ins) != NO_ARGC) {
+                    os << " " << SecondOf(ins);
+                }
+                break;
+            case Op::PUSH_CONST:
+            case Op::ADD_CONST:
+            case Op::SUB_CONST:
+            case Op::MUL_CONST:
+            case Op::DIV_CONST:
+                os << " #" << OperandOf(ins) << " (" << program.constants.At(OperandOf(ins)) << ")";
+                break;
+            case Op::PUSH_CALL:
+                os << " #" << FirstOf(ins) << " (" << program.constants.At(FirstOf(ins)) << ")"
+                   << " @" << SecondOf(ins) << " (" << program.imports[SecondOf(ins)]->View() << ")";
+                break;
+            default:
+                break;
+        }
+        os << '\n';
+    }
+    return os;
+}
+
+};
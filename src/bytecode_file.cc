@@ -0,0 +1,269 @@
+#include <bit>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "theatre/bytecode_file.hh"
+
+namespace theatre {
+
+// files are read in place, so they are only portable between little endian hosts
+static_assert(std::endian::native == std::endian::little, ".tbc files assume a little endian host");
+static_assert(sizeof(TbcHeader) % 4 == 0 && sizeof(TbcConstant) == 8);
+
+static constexpr uint16_t OP_COUNT = static_cast<uint16_t>(magic_enum::enum_count<Op>());
+
+static uint32_t AlignTo4(size_t offset) {
+    return static_cast<uint32_t>((offset + 3) & ~size_t(3));
+}
+
+void WriteBytecode(std::ostream& out, const Bytecode& program) {
+    // strings are written once, however often they are used
+    std::string strings;
+    std::unordered_map<std::string_view, uint32_t> offsets;
+    const auto AddString = [&](std::string_view text) {
+        const auto [it, inserted] = offsets.try_emplace(text, static_cast<uint32_t>(strings.size()));
+        if (inserted) {
+            const uint32_t length = static_cast<uint32_t>(text.size());
+            strings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            strings.append(text);
+            strings.resize(AlignTo4(strings.size()));
+        }
+        return it->second;
+    };
+
+    std::vector<TbcConstant> constants;
+    constants.reserve(program.constants.Size());
+    for (size_t i = 0; i < program.constants.Size(); i++) {
+        const Value& value = program.constants.At(static_cast<uint32_t>(i));
+        TbcConstant constant { static_cast<uint32_t>(value.Type()), 0 };
+        if (value.IsString()) {
+            constant.value = AddString(value.AsString());
+        } else {
+            constant.value = static_cast<uint32_t>(value.Bits() >> 32);
+        }
+        constants.emplace_back(constant);
+    }
+
+    std::vector<uint32_t> imports;
+    imports.reserve(program.imports.size());
+    for (Symbol name: program.imports) {
+        imports.emplace_back(AddString(name->View()));
+    }
+
+    TbcHeader header {};
+    std::memcpy(header.magic, TBC_MAGIC, sizeof(TBC_MAGIC));
+    header.version = TBC_VERSION;
+    header.opCount = OP_COUNT;
+    header.code = { sizeof(TbcHeader), static_cast<uint32_t>(program.code.size()) };
+    header.constants = { header.code.offset + header.code.count * static_cast<uint32_t>(sizeof(Instruction)),
+                         static_cast<uint32_t>(constants.size()) };
+    header.imports = { header.constants.offset + header.constants.count * static_cast<uint32_t>(sizeof(TbcConstant)),
+                       static_cast<uint32_t>(imports.size()) };
+    header.strings = { header.imports.offset + header.imports.count * static_cast<uint32_t>(sizeof(uint32_t)),
+                       static_cast<uint32_t>(strings.size()) };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(program.code.data()), program.code.size() * sizeof(Instruction));
+    out.write(reinterpret_cast<const char*>(constants.data()), constants.size() * sizeof(TbcConstant));
+    out.write(reinterpret_cast<const char*>(imports.data()), imports.size() * sizeof(uint32_t));
+    out.write(strings.data(), strings.size());
+}
+
+void SaveBytecode(const std::filesystem::path& path, const Bytecode& program) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw BytecodeFileError(std::format("Could not open {} for writing", path.string()));
+    }
+    WriteBytecode(out, program);
+    if (!out) {
+        throw BytecodeFileError(std::format("Could not write {}", path.string()));
+    }
+}
+
+// Copy-on-write mapping of a whole file, unmapped when the last program
+// borrowing its instructions goes away.
+class FileMapping
+{
+public:
+    explicit FileMapping(const std::filesystem::path& path) {
+#ifdef _WIN32
+        const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw BytecodeFileError(std::format("Could not open {}", path.string()));
+        }
+        LARGE_INTEGER fileSize {};
+        GetFileSizeEx(file, &fileSize);
+        size = static_cast<size_t>(fileSize.QuadPart);
+        const HANDLE mapping = size ? CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr) : nullptr;
+        CloseHandle(file);
+        if (mapping) {
+            data = static_cast<std::byte*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw BytecodeFileError(std::format("Could not open {}", path.string()));
+        }
+        struct stat info {};
+        fstat(fd, &info);
+        size = static_cast<size_t>(info.st_size);
+        if (size) {
+            void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            data = mapped == MAP_FAILED ? nullptr : static_cast<std::byte*>(mapped);
+        }
+        close(fd);
+#endif
+        if (!data && size) {
+            throw BytecodeFileError(std::format("Could not map {}", path.string()));
+        }
+    }
+
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+
+    ~FileMapping() {
+        if (!data) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, size);
+#endif
+    }
+
+    std::byte* Data() const {
+        return data;
+    }
+
+    size_t Size() const {
+        return size;
+    }
+
+private:
+    std::byte* data = nullptr;
+    size_t size = 0;
+};
+
+static void CheckSection(const std::filesystem::path& path, const char* name,
+                         const TbcSection& section, size_t entrySize, size_t fileSize) {
+    const uint64_t end = uint64_t(section.offset) + uint64_t(section.count) * entrySize;
+    if (section.offset % 4 != 0 || end > fileSize) {
+        throw BytecodeFileError(std::format("Corrupt {} section in {}", name, path.string()));
+    }
+}
+
+Bytecode LoadBytecode(const std::filesystem::path& path, StringTable& strings) {
+    auto file = std::make_shared<FileMapping>(path);
+    if (file->Size() < sizeof(TbcHeader)) {
+        throw BytecodeFileError(std::format("Not a .tbc file: {}", path.string()));
+    }
+
+    TbcHeader header;
+    std::memcpy(&header, file->Data(), sizeof(header));
+    if (std::memcmp(header.magic, TBC_MAGIC, sizeof(TBC_MAGIC)) != 0) {
+        throw BytecodeFileError(std::format("Not a .tbc file: {}", path.string()));
+    }
+    if (header.version != TBC_VERSION) {
+        throw BytecodeFileError(std::format("{} has version {}, expected version {}",
+                                            path.string(), header.version, TBC_VERSION));
+    }
+    if (header.opCount != OP_COUNT) {
+        throw BytecodeFileError(std::format("{} was written for a different instruction set", path.string()));
+    }
+    CheckSection(path, "code", header.code, sizeof(Instruction), file->Size());
+    CheckSection(path, "constant", header.constants, sizeof(TbcConstant), file->Size());
+    CheckSection(path, "import", header.imports, sizeof(uint32_t), file->Size());
+    CheckSection(path, "string", header.strings, 1, file->Size());
+
+    const std::byte* base = file->Data();
+    const auto ReadString = [&](uint32_t offset) {
+        uint32_t length = 0;
+        if (uint64_t(offset) + sizeof(length) <= header.strings.count) {
+            std::memcpy(&length, base + header.strings.offset + offset, sizeof(length));
+            if (uint64_t(offset) + sizeof(length) + length <= header.strings.count) {
+                return std::string_view(reinterpret_cast<const char*>(base) + header.strings.offset
+                                        + offset + sizeof(length), length);
+            }
+        }
+        throw BytecodeFileError(std::format("Corrupt string section in {}", path.string()));
+    };
+
+    Bytecode program;
+    const TbcConstant* constants = reinterpret_cast<const TbcConstant*>(base + header.constants.offset);
+    for (uint32_t i = 0; i < header.constants.count; i++) {
+        const TbcConstant& constant = constants[i];
+        Value value;
+        switch (static_cast<AnyType>(constant.type)) {
+            case AnyType::MONO: break;
+            case AnyType::INT: value = Value::Int(static_cast<int>(constant.value)); break;
+            case AnyType::FLOAT: value = Value::Float(std::bit_cast<float>(constant.value)); break;
+            case AnyType::BOOL: value = Value::Bool(constant.value != 0); break;
+            case AnyType::STRING: value = Value::Shared(ReadString(constant.value), strings); break;
+            default:
+                throw BytecodeFileError(std::format("Corrupt constant {} in {}", i, path.string()));
+        }
+        // the writer only writes distinct constants
+        if (program.constants.Add(value) != i) {
+            throw BytecodeFileError(std::format("Duplicate constant {} in {}", i, path.string()));
+        }
+    }
+
+    const uint32_t* imports = reinterpret_cast<const uint32_t*>(base + header.imports.offset);
+    program.imports.reserve(header.imports.count);
+    for (uint32_t i = 0; i < header.imports.count; i++) {
+        program.imports.emplace_back(strings.Intern(ReadString(imports[i])));
+    }
+
+    // the virtual machine trusts operands, so every one is checked here
+    const std::span<Instruction> code(reinterpret_cast<Instruction*>(file->Data() + header.code.offset),
+                                      header.code.count);
+    const auto Expect = [&](size_t pc, bool valid) {
+        if (!valid) {
+            throw BytecodeFileError(std::format("Corrupt instruction {} in {}", pc, path.string()));
+        }
+    };
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        const Instruction ins = code[pc];
+        Expect(pc, (ins & 0xFF) < OP_COUNT);
+        switch (OpOf(ins)) {
+            case Op::PUSH_CONST:
+            case Op::ADD_CONST:
+            case Op::SUB_CONST:
+            case Op::MUL_CONST:
+            case Op::DIV_CONST:
+                Expect(pc, OperandOf(ins) < header.constants.count);
+                break;
+            case Op::CALL:
+                Expect(pc, FirstOf(ins) < header.imports.count);
+                break;
+            case Op::PUSH_CALL:
+                Expect(pc, FirstOf(ins) < header.constants.count && SecondOf(ins) < header.imports.count);
+                break;
+            default:
+                break;
+        }
+    }
+
+    program.code = InstructionStream(code, std::move(file));
+    return program;
+}
+
+};
@@ -0,0 +1,44 @@
+#include <algorithm>
+
+#include "theatre/history.hh"
+
+namespace theatre {
+
+History::History(HistoryMode mode, size_t capacity)
+    : mode(mode), capacity(capacity)
+{
+    if (mode == HistoryMode::LAST_N) {
+        if (this->capacity == 0) {
+            this->mode = HistoryMode::OFF;
+        } else {
+            ring = std::make_shared<std::vector<HistoryEntry>>(capacity);
+        }
+    }
+}
+
+size_t History::Size() const {
+    switch (mode) {
+        case HistoryMode::LAST_N:
+            return count;
+        case HistoryMode::FULL:
+            return full.Size();
+        default:
+            return 0;
+    }
+}
+
+void History::Record(Opcode code, const Value& operand) {
+    const HistoryEntry entry{ code, operand };
+    if (mode == HistoryMode::FULL) {
+        full.Push(entry);
+    } else if (mode == HistoryMode::LAST_N) {
+        if (ring.use_count() > 1) {
+            ring = std::make_shared<std::vector<HistoryEntry>>(*ring);
+        }
+        (*ring)[head] = entry;
+        head = (head + 1) % capacity;
+        count = std::min(count + 1, capacity);
+    }
+}
+
+};
@@ -1,9 +1,13 @@
-#include <unordered_map>
-#include <optional>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <format>
 #include <iostream>
+#include <limits>
 
 #include "theatre/lexer.hh"
-#include "theatre/utils.hh"
+#include "theatre/scan.hh"
 
 namespace theatre {
 
@@ -27,85 +31,445 @@ for (int i = 0; i < 2; i++)
 }
 )";
 
-static std::vector<Token> Lex(std::vector<Token>& tokens, const std::string_view& text)
+// The lexer is one deterministic automaton built at compile time: a trie of
+// every static token and type name, where leaving a keyword's path on a
+// letter or digit continues as an identifier, plus number and string states.
+// Each token is the longest prefix that ends in an accepting state, so
+// lexing looks at every character once.
+namespace {
+
+constexpr uint8_t DEAD = 0;
+constexpr uint8_t START = 1;
+constexpr uint8_t IDENT = 2;
+constexpr uint8_t NUMBER = 3;
+constexpr uint8_t NUMBER_DOT = 4; // a dot must be followed by a digit
+constexpr uint8_t FLOAT = 5;
+constexpr uint8_t STRING = 6;
+constexpr uint8_t STRING_END = 7;
+constexpr uint8_t FIRST_TRIE = 8;
+constexpr size_t MAX_STATES = 96;
+constexpr int8_t REJECT = -1;
+
+constexpr bool IsSpace(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+constexpr bool IsDigit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool IsIdentStart(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+constexpr bool IsIdentChar(unsigned char c) {
+    return IsIdentStart(c) || IsDigit(c);
+}
+
+struct LexerTable
 {
-    if (text.empty()) {
-        return tokens;
+    std::array<std::array<uint8_t, 256>, MAX_STATES> next {};
+    std::array<int8_t, MAX_STATES> accepts {}; // TokenType or REJECT
+    std::array<bool, MAX_STATES> word {}; // trie node spelled with identifier characters only
+    size_t states = FIRST_TRIE;
+
+    constexpr void Insert(std::string_view text, TokenType type) {
+        uint8_t state = START;
+        bool isWord = true;
+        for (const char ch : text) {
+            const unsigned char c = static_cast<unsigned char>(ch);
+            isWord = isWord && IsIdentChar(c);
+            if (next[state][c] == DEAD) {
+                if (states == MAX_STATES) {
+                    throw "Static tokens do not fit the lexer table, raise MAX_STATES";
+                }
+                word[states] = isWord;
+                next[state][c] = static_cast<uint8_t>(states++);
+            }
+            state = next[state][c];
+        }
+        accepts[state] = static_cast<int8_t>(type);
     }
+};
 
-    for (auto i = 0; i < text.size(); i++) {
-        const auto length = std::min(MAX_TOKEN_LEN, text.size() - i);
-        const std::string_view view(text.data() + i, length);
+consteval LexerTable BuildTable() {
+    LexerTable table;
+    table.accepts.fill(REJECT);
+    for (const Token& token : StaticTokens) {
+        table.Insert(token.value, token.type);
+    }
+    for (const char* type : TypeNames) {
+        table.Insert(type, TokenType::TYPE);
+    }
 
-        // skip whitespace
-        if (std::isspace(view.front())) {
-            continue;
+    const auto Fill = [&](uint8_t state, auto matches, uint8_t target) {
+        for (int c = 0; c < 256; c++) {
+            if (table.next[state][c] == DEAD && matches(static_cast<unsigned char>(c))) {
+                table.next[state][c] = target;
+            }
         }
+    };
 
-        std::optional<Token> found = std::nullopt;
+    // a keyword followed by more letters is an identifier
+    for (size_t state = FIRST_TRIE; state < table.states; state++) {
+        if (table.word[state]) {
+            Fill(static_cast<uint8_t>(state), IsIdentChar, IDENT);
+            if (table.accepts[state] == REJECT) {
+                table.accepts[state] = static_cast<int8_t>(TokenType::IDENT);
+            }
+        }
+    }
 
-        {
-            std::string_view subView(view);
+    Fill(START, IsIdentStart, IDENT);
+    Fill(START, IsDigit, NUMBER);
+    Fill(START, [](unsigned char c) { return c == '"'; }, STRING);
+    Fill(IDENT, IsIdentChar, IDENT);
+    Fill(NUMBER, IsDigit, NUMBER);
+    Fill(NUMBER, [](unsigned char c) { return c == '.'; }, NUMBER_DOT);
+    Fill(NUMBER_DOT, IsDigit, FLOAT);
+    Fill(FLOAT, IsDigit, FLOAT);
+    // strings end at the closing quote and may not span lines
+    Fill(STRING, [](unsigned char c) { return c == '"'; }, STRING_END);
+    Fill(STRING, [](unsigned char c) { return c != '\n'; }, STRING);
 
-            while (!subView.empty()) {
-                // find static tokens
-                for (Token tok : StaticTokens) {
-                    if (subView == tok.value) {
-                        tokens.emplace_back(tok);
-                        cdebug << "Found token: " << tok << '\n';
-                        found.emplace(tok);
-                        break;
-                    }
-                }
+    table.accepts[IDENT] = static_cast<int8_t>(TokenType::IDENT);
+    table.accepts[NUMBER] = static_cast<int8_t>(TokenType::LITERAL);
+    table.accepts[FLOAT] = static_cast<int8_t>(TokenType::LITERAL);
+    table.accepts[STRING_END] = static_cast<int8_t>(TokenType::LITERAL);
+    return table;
+}
 
-                // find types
-                for (const std::string& type : TypeNames)
-                {
-                    if (subView == type) {
-                        Token tok(TokenType::TYPE, type);
-                        tokens.emplace_back(tok);
-                        cdebug << "Found type: " << tok << '\n';
-                        found.emplace(tok);
-                        break;
-                    }
-                }
+constexpr LexerTable TABLE = BuildTable();
+
+}
+
+namespace {
 
-                subView = std::string_view(subView.data(), subView.size() - 1);
+struct Lexeme
+{
+    TokenType type;
+    size_t offset;
+    size_t length;
+    int row;
+    int col;
+};
+
+enum class Step
+{
+    TOKEN,
+    MORE, // the text ran out where more input could change the result
+    END,
+};
+
+// Lexes the next token at or after pos, skipping whitespace and calling
+// newline(offset) for each line break it skips. Unless final says the text
+// is all there is, a token touching its end is not taken, as more input
+// might continue it, and the whitespace before it stays consumed.
+template <typename NewLine>
+Step ScanStep(std::string_view text, bool final, size_t& pos, int& row, int& col, Lexeme& lexeme, NewLine newline)
+{
+    const ScanKernels& kernels = ScanKernels::Best();
+    const char* const data = text.data();
+    const char* const last = data + text.size();
+
+    while (pos < text.size()) {
+        const unsigned char first = static_cast<unsigned char>(text[pos]);
+        if (IsSpace(first)) {
+            const size_t stop = kernels.skipSpace(data + pos, last) - data;
+            size_t lineStart = std::string_view::npos;
+            const char* nl = data + pos;
+            while ((nl = static_cast<const char*>(std::memchr(nl, '\n', data + stop - nl)))) {
+                newline(nl - data);
+                row++;
+                lineStart = ++nl - data;
             }
+            col = lineStart == std::string_view::npos ? col + static_cast<int>(stop - pos)
+                                                      : static_cast<int>(stop - lineStart) + 1;
+            pos = stop;
+            continue;
         }
 
-        // TODO: find literals
-
-        // find identifiers
-        if (!found.has_value())
-        {
-            // find next non alpha character
-            for (auto j = 0; j < length; j++) {
-                if (!std::isalpha(view[j])) {
-                    Token identToken(TokenType::IDENT, view.substr(0, j)); // TODO fix: idents can have empty value
-                    cdebug << "Found identifier token: '" << identToken.value.data() << "'\n";
-                    tokens.emplace_back(identToken);
-                    found.emplace(identToken);
-                    break;
-                }
+        // run the automaton as far as it goes, remembering the last accept
+        uint8_t state = START;
+        size_t end = 0;
+        int8_t type = REJECT;
+        for (size_t i = pos; i < text.size(); i++) {
+            state = TABLE.next[state][static_cast<unsigned char>(text[i])];
+            if (state == DEAD) {
+                break;
+            }
+            // these states loop on their whole class, skip it in bulk
+            if (state == IDENT) {
+                i = kernels.skipIdent(data + i + 1, last) - data - 1;
+            } else if (state == NUMBER || state == FLOAT) {
+                i = kernels.skipDigits(data + i + 1, last) - data - 1;
+            }
+            if (TABLE.accepts[state] != REJECT) {
+                end = i + 1;
+                type = TABLE.accepts[state];
             }
         }
 
-        if (!found) {
-            throw LexerError("Didn't find anything?!");
+        if (state != DEAD && !final) {
+            return Step::MORE;
+        }
+
+        if (type == REJECT) {
+            if (first == '"') {
+                throw LexerError(std::format("Unterminated string at {}:{}", row, col));
+            }
+            throw LexerError(std::format("Unexpected character '{}' at {}:{}", static_cast<char>(first), row, col));
         }
 
-        int skip = static_cast<int>(found->value.Length());
-        i += std::max(0, skip - 1);
+        lexeme = Lexeme{ static_cast<TokenType>(type), pos, end - pos, row, col };
+        col += static_cast<int>(end - pos);
+        pos = end;
+        return Step::TOKEN;
+    }
+    return final ? Step::END : Step::MORE;
+}
+
+// Calls emit(lexeme) for every token of a complete text.
+template <typename Emit, typename NewLine>
+void Scan(std::string_view text, Emit emit, NewLine newline)
+{
+    int row = 1;
+    int col = 1;
+    size_t pos = 0;
+    Lexeme lexeme;
+    while (ScanStep(text, true, pos, row, col, lexeme, newline) == Step::TOKEN) {
+        emit(lexeme);
+    }
+}
+
+// First index in [first, last) that pred does not hold for, it holds for a prefix.
+template <typename Pred>
+size_t PartitionPoint(size_t first, size_t last, Pred pred)
+{
+    while (first < last) {
+        const size_t mid = first + (last - first) / 2;
+        if (pred(mid)) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+}
+
+ChunkReader ReadChunks(std::istream& in)
+{
+    return [&in](char* buffer, size_t size) -> size_t {
+        in.read(buffer, static_cast<std::streamsize>(size));
+        return static_cast<size_t>(in.gcount());
+    };
+}
+
+TokenStream::TokenStream(std::string_view text) : window(text), final(true)
+{
+}
+
+TokenStream::TokenStream(ChunkReader reader, size_t chunkSize)
+    : reader(std::move(reader)), chunkSize(std::max<size_t>(chunkSize, 1))
+{
+}
+
+std::optional<Token> TokenStream::Next()
+{
+    Lexeme lexeme;
+    for (;;) {
+        switch (ScanStep(window, final, pos, row, col, lexeme, [](size_t) {})) {
+            case Step::TOKEN:
+                return Token(lexeme.type, window.substr(lexeme.offset, lexeme.length)).At(lexeme.col, lexeme.row);
+            case Step::END:
+                return std::nullopt;
+            case Step::MORE:
+                Refill();
+                break;
+        }
     }
+}
 
-   return tokens;
+void TokenStream::Refill()
+{
+    // keep the unfinished token, the window only grows past a chunk for tokens longer than one
+    buffer.erase(0, pos);
+    pos = 0;
+    const size_t kept = buffer.size();
+    buffer.resize(kept + chunkSize);
+    const size_t read = reader(buffer.data() + kept, chunkSize);
+    buffer.resize(kept + read);
+    final = read == 0;
+    window = buffer;
 }
 
 std::vector<Token> LexText(const std::string_view& text)
 {
     std::vector<Token> tokens{};
-    return Lex(tokens, text);
+    TokenStream stream(text);
+    while (std::optional<Token> token = stream.Next()) {
+        tokens.emplace_back(*token);
+    }
+    return tokens;
+}
+
+TokenBuffer::TokenBuffer(std::string source)
+{
+    if (source.size() > std::numeric_limits<uint32_t>::max()) {
+        throw LexerError("Sources larger than 4 GiB are not supported");
+    }
+    std::vector<CompactToken> lexed;
+    std::vector<uint32_t> starts{ 0 };
+    Scan(source, [&](const Lexeme& lexeme) {
+        if (lexeme.length > CompactToken::MAX_LENGTH) {
+            throw LexerError(std::format("Token at offset {} is longer than {} characters",
+                                         lexeme.offset, CompactToken::MAX_LENGTH));
+        }
+        lexed.emplace_back(CompactToken::Of(lexeme.type, static_cast<uint32_t>(lexeme.offset),
+                                            static_cast<uint32_t>(lexeme.length)));
+    }, [&](size_t offset) {
+        starts.emplace_back(static_cast<uint32_t>(offset + 1));
+    });
+    text = GapBuffer<char>(std::vector<char>(source.begin(), source.end()));
+    tokens = GapBuffer<CompactToken>(std::move(lexed));
+    lines = GapBuffer<uint32_t>(std::move(starts));
+}
+
+SourcePosition TokenBuffer::Position(const CompactToken& token) const
+{
+    return Position(token.offset);
+}
+
+SourcePosition TokenBuffer::Position(size_t offset) const
+{
+    const size_t line = PartitionPoint(0, lines.size(), [&](size_t i) { return LineAt(i) <= offset; }) - 1;
+    return SourcePosition{ static_cast<int>(line) + 1, static_cast<int>(offset - LineAt(line)) + 1 };
+}
+
+TokenSplice TokenBuffer::Edit(const TextEdit& edit)
+{
+    const size_t size = text.size();
+    if (edit.offset > size || edit.removed > size - edit.offset) {
+        throw LexerError(std::format("Edit of {} characters at {} is outside of the source", edit.removed, edit.offset));
+    }
+    if (size - edit.removed + edit.inserted.size() > std::numeric_limits<uint32_t>::max()) {
+        throw LexerError("Sources larger than 4 GiB are not supported");
+    }
+    const size_t removedEnd = edit.offset + edit.removed;
+    const size_t insertedEnd = edit.offset + edit.inserted.size();
+    const int64_t delta = static_cast<int64_t>(edit.inserted.size()) - static_cast<int64_t>(edit.removed);
+
+    // A token's end depends on the character after it, so the first token
+    // that can change is the one reaching the edit. Start a token earlier
+    // for the automaton looking one more character ahead after numbers.
+    size_t first = PartitionPoint(0, tokens.size(), [&](size_t i) {
+        const CompactToken token = (*this)[i];
+        return token.offset + token.length < edit.offset;
+    });
+    first -= first > 0;
+    const size_t from = first < tokens.size() ? std::min<size_t>((*this)[first].offset, edit.offset) : edit.offset;
+
+    // old tokens that may still be there after the edit
+    size_t old = PartitionPoint(first, tokens.size(), [&](size_t i) { return (*this)[i].offset < removedEnd; });
+
+    // line starts the edit removes, line breaks are only ever whitespace
+    const size_t linesFrom = PartitionPoint(0, lines.size(), [&](size_t i) { return LineAt(i) <= edit.offset; });
+    const size_t linesTo = PartitionPoint(linesFrom, lines.size(), [&](size_t i) { return LineAt(i) <= removedEnd; });
+
+    // nothing before the edit moves, the position is the same in the new source
+    const SourcePosition start = Position(from);
+
+    // the edit goes right in front of the gap, so the text lexed from is contiguous
+    text.MoveGap(removedEnd);
+    const std::string removedText(text.Before().data() + edit.offset, edit.removed);
+    text.EraseBefore(edit.removed);
+    text.Insert(edit.inserted);
+
+    // offsets of the old tokens in the old source
+    const auto OldOffset = [&](size_t i) {
+        const int64_t offset = tokens[i].offset;
+        return i >= tokens.Gap() ? static_cast<int64_t>(size) - offset : offset;
+    };
+
+    std::vector<CompactToken> lexed;
+    try {
+        int row = start.row;
+        int col = start.col;
+        size_t pos = from;
+        size_t grow = 256;
+        Lexeme lexeme;
+        for (;;) {
+            const std::span<const char> before = text.Before();
+            const Step step = ScanStep(std::string_view(before.data(), before.size()), before.size() == text.size(),
+                                       pos, row, col, lexeme, [](size_t) {});
+            if (step == Step::MORE) {
+                // take more of the source in front of the gap, as much again each time
+                text.MoveGap(std::min(text.size(), text.Gap() + grow));
+                grow *= 2;
+                continue;
+            }
+            if (step == Step::END) {
+                old = tokens.size();
+                break;
+            }
+            if (lexeme.offset >= insertedEnd) {
+                // the rest of the source is as it was, once a token starts where one did all the others do
+                const int64_t offset = static_cast<int64_t>(lexeme.offset);
+                while (old < tokens.size() && OldOffset(old) + delta < offset) {
+                    old++;
+                }
+                if (old < tokens.size() && OldOffset(old) + delta == offset) {
+                    // keep the gap out of tokens
+                    text.MoveGap(lexeme.offset);
+                    break;
+                }
+            }
+            if (lexeme.length > CompactToken::MAX_LENGTH) {
+                throw LexerError(std::format("Token at offset {} is longer than {} characters",
+                                             lexeme.offset, CompactToken::MAX_LENGTH));
+            }
+            lexed.emplace_back(CompactToken::Of(lexeme.type, static_cast<uint32_t>(lexeme.offset),
+                                                static_cast<uint32_t>(lexeme.length)));
+        }
+    } catch (...) {
+        text.MoveGap(insertedEnd);
+        text.EraseBefore(edit.inserted.size());
+        text.Insert(removedText);
+        text.MoveGap(from);
+        throw;
+    }
+
+    // Offsets in front of the gaps count from the start of the source and the
+    // ones behind them from its end, which is where the size changes. Moving
+    // the gaps to the edit converts what they pass, in the old source.
+    tokens.MoveGap(old, [&](CompactToken token, bool) {
+        token.offset = static_cast<uint32_t>(size - token.offset);
+        return token;
+    });
+    tokens.EraseBefore(old - first);
+    tokens.Insert(lexed);
+
+    lines.MoveGap(linesTo, [&](uint32_t line, bool) {
+        return static_cast<uint32_t>(size - line);
+    });
+    lines.EraseBefore(linesTo - linesFrom);
+    for (size_t i = 0; i < edit.inserted.size(); i++) {
+        if (edit.inserted[i] == '\n') {
+            const uint32_t line = static_cast<uint32_t>(edit.offset + i + 1);
+            lines.Insert(std::span(&line, 1));
+        }
+    }
+    return TokenSplice{ first, old - first, lexed.size() };
+}
+
+Token TokenBuffer::Expand(const CompactToken& token) const
+{
+    const SourcePosition position = Position(token);
+    Token expanded(token.Type(), Text(token));
+    expanded.At(position.col, position.row);
+    return expanded;
 }
 
 };
\ No newline at end of file
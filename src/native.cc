@@ -0,0 +1,12 @@
+#include <format>
+
+#include "theatre/native.hh"
+
+namespace theatre {
+
+void ThrowArgumentType(const std::string& name, size_t index, AnyType expected, AnyType actual) {
+    throw ArgumentError(std::format("Function {} expects {} for argument {} but got {}.",
+                                    name, TypeName(expected), index, TypeName(actual)));
+}
+
+};
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <climits>
+#include <format>
+#include <optional>
+
+#include "theatre/optimizer.hh"
+
+namespace theatre {
+
+// What is known about a stack slot before the program runs.
+// Slots below the ones the pass has seen are unknown.
+struct Slot
+{
+    std::optional<Any> constant;
+    std::optional<AnyType> type;
+    size_t origin = SIZE_MAX; // index of the PUSH that produced it
+};
+
+// variant alternatives are in AnyType order
+static AnyType TypeOf(const Any& value) {
+    return static_cast<AnyType>(value.index());
+}
+
+// Type of a op b, when the op does not throw
+static std::optional<AnyType> ResultType(Opcode code, std::optional<AnyType> a, std::optional<AnyType> b) {
+    if (!a || !b) {
+        return std::nullopt;
+    }
+    if (code == Opcode::ADD && a == AnyType::STRING && b == AnyType::STRING) {
+        return AnyType::STRING;
+    }
+    const auto IsNumeric = [](AnyType type) {
+        return type == AnyType::INT || type == AnyType::FLOAT;
+    };
+    if (!IsNumeric(*a) || !IsNumeric(*b)) {
+        return std::nullopt;
+    }
+    return a == AnyType::FLOAT || b == AnyType::FLOAT ? AnyType::FLOAT : AnyType::INT;
+}
+
+// Evaluates a op b like the virtual machine would. Nothing is returned when
+// it would fail at runtime, that is left for the program to report.
+static std::optional<Any> Fold(Opcode code, const Any& a, const Any& b) {
+    try {
+        switch (code) {
+            case Opcode::ADD: return a + b;
+            case Opcode::SUB: return a - b;
+            case Opcode::MUL: return a * b;
+            case Opcode::DIV: {
+                if (!a.IsType<float>() && !b.IsType<float>()) {
+                    const int dividend = a.Value<int>();
+                    const int divisor = b.Value<int>();
+                    if (divisor == 0 || (dividend == INT_MIN && divisor == -1)) {
+                        return std::nullopt;
+                    }
+                }
+                return a / b;
+            }
+            default: break;
+        }
+    } catch (OperationError&) {
+    }
+    return std::nullopt;
+}
+
+// PUSH 0 / ADD and PUSH 1 / MUL only leave ints untouched, floats would
+// lose the sign of -0.0 and other types raise an error.
+static bool IsIdentity(Opcode code, const Any& constant, std::optional<AnyType> operand) {
+    if (operand != AnyType::INT || !constant.IsType<int>()) {
+        return false;
+    }
+    const int value = constant.Extract<int>();
+    return (code == Opcode::ADD && value == 0) || (code == Opcode::MUL && value == 1);
+}
+
+static Opcode Fused(Opcode code) {
+    switch (code) {
+        case Opcode::ADD: return Opcode::ADD_CONST;
+        case Opcode::SUB: return Opcode::SUB_CONST;
+        case Opcode::MUL: return Opcode::MUL_CONST;
+        default: return Opcode::DIV_CONST;
+    }
+}
+
+static std::optional<Opcode> Unfused(Opcode code) {
+    switch (code) {
+        case Opcode::ADD_CONST: return Opcode::ADD;
+        case Opcode::SUB_CONST: return Opcode::SUB;
+        case Opcode::MUL_CONST: return Opcode::MUL;
+        case Opcode::DIV_CONST: return Opcode::DIV;
+        default: return std::nullopt;
+    }
+}
+
+class Peephole
+{
+public:
+    explicit Peephole(const OptimizeOptions& options) : options(options)
+    {
+    }
+
+    void Feed(const Command& cmd) {
+        switch (cmd.code) {
+            case Opcode::PUSH:
+                Push(cmd.value);
+                break;
+            case Opcode::ADD:
+            case Opcode::SUB:
+            case Opcode::MUL:
+            case Opcode::DIV:
+                Binary(cmd.code);
+                break;
+            case Opcode::CALL:
+                if (cmd.operand.IsMono()) {
+                    Call(cmd.value);
+                } else {
+                    // PUSH_CALL has no room for an argument count
+                    out.emplace_back(cmd);
+                    stack.clear();
+                }
+                break;
+            case Opcode::PUSH_CALL:
+                Push(cmd.value);
+                Call(cmd.operand);
+                break;
+            default:
+                // handled as the pair it stands for, so it can fold further
+                Push(cmd.value);
+                Binary(*Unfused(cmd.code));
+                break;
+        }
+    }
+
+    std::vector<Command> Finish() {
+        return std::move(out);
+    }
+
+private:
+    const OptimizeOptions& options;
+    std::vector<Command> out;
+    std::vector<Slot> stack;
+
+    void Push(const Any& value) {
+        stack.emplace_back(Slot{ value, TypeOf(value), out.size() });
+        out.emplace_back(Command{ Opcode::PUSH, value, {} });
+    }
+
+    Slot Pop() {
+        if (stack.empty()) {
+            return {};
+        }
+        Slot slot = std::move(stack.back());
+        stack.pop_back();
+        return slot;
+    }
+
+    // the slot was pushed by the last emitted instruction minus offset
+    bool IsPending(const Slot& slot, size_t offset) const {
+        return slot.constant && slot.origin + offset + 1 == out.size();
+    }
+
+    void Call(const Any& name) {
+        if (options.fuse && !out.empty() && out.back().code == Opcode::PUSH) {
+            out.back() = Command{ Opcode::PUSH_CALL, out.back().value, name };
+        } else {
+            out.emplace_back(Command{ Opcode::CALL, name, {} });
+        }
+        // hooks eat part of the stack and maybe push a result
+        stack.clear();
+    }
+
+    void Binary(Opcode code) {
+        // the top of the stack is the left operand
+        Slot a = Pop();
+        Slot b = Pop();
+
+        if (options.foldConstants && IsPending(a, 0) && IsPending(b, 1)) {
+            if (std::optional<Any> folded = Fold(code, *a.constant, *b.constant)) {
+                out.resize(out.size() - 2);
+                Push(*folded);
+                return;
+            }
+        }
+
+        if (options.removeNoops && IsPending(a, 0) && IsIdentity(code, *a.constant, b.type)) {
+            out.pop_back();
+            stack.emplace_back(std::move(b));
+            return;
+        }
+
+        const Slot result{ std::nullopt, ResultType(code, a.type, b.type) };
+        if (options.fuse && IsPending(a, 0)) {
+            out.back() = Command{ Fused(code), *a.constant, {} };
+        } else {
+            out.emplace_back(Command{ code, {}, {} });
+        }
+        stack.emplace_back(result);
+    }
+};
+
+std::vector<Command> Optimize(const std::vector<Command>& program, const OptimizeOptions& options) {
+    Peephole pass(options);
+    for (const Command& cmd: program) {
+        pass.Feed(cmd);
+    }
+    return pass.Finish();
+}
+
+PairProfile::PairProfile() : counts(OPCODES * OPCODES, 0)
+{
+}
+
+void PairProfile::Add(const std::vector<Command>& program) {
+    for (size_t i = 1; i < program.size(); i++) {
+        counts[Index(program[i - 1].code, program[i].code)]++;
+    }
+    if (program.size() > 1) {
+        total += program.size() - 1;
+    }
+}
+
+size_t PairProfile::Count(Opcode first, Opcode second) const {
+    return counts[Index(first, second)];
+}
+
+std::vector<OpcodePair> PairProfile::MostFrequent(size_t limit) const {
+    std::vector<OpcodePair> pairs;
+    for (const Opcode first: magic_enum::enum_values<Opcode>()) {
+        for (const Opcode second: magic_enum::enum_values<Opcode>()) {
+            if (const size_t count = Count(first, second)) {
+                pairs.emplace_back(OpcodePair{ first, second, count });
+            }
+        }
+    }
+    // ties keep opcode order so reports are stable
+    std::stable_sort(pairs.begin(), pairs.end(), [](const OpcodePair& a, const OpcodePair& b) {
+        return a.count > b.count;
+    });
+    if (pairs.size() > limit) {
+        pairs.resize(limit);
+    }
+    return pairs;
+}
+
+std::ostream& operator<<(std::ostream& os, const PairProfile& profile) {
+    os << "Opcode pairs: " << profile.total << '\n';
+    for (const OpcodePair& pair: profile.MostFrequent()) {
+        os << std::format("{:>8} {:5.1f}% {} -> {}\n", pair.count,
+                          100.0 * pair.count / profile.total,
+                          magic_enum::enum_name<Opcode>(pair.first),
+                          magic_enum::enum_name<Opcode>(pair.second));
+    }
+    return os;
+}
+
+};
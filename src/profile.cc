@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <bit>
+#include <format>
+
+#include "theatre/profile.hh"
+
+namespace theatre {
+
+void LatencyHistogram::Add(uint64_t nanos) {
+    const size_t bucket = std::min<size_t>(std::bit_width(nanos), BUCKETS - 1);
+    buckets[bucket]++;
+    count++;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+}
+
+uint64_t LatencyHistogram::Percentile(double fraction) const {
+    const uint64_t rank = static_cast<uint64_t>(fraction * count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > rank || seen == count) {
+            return uint64_t(1) << i;
+        }
+    }
+    return 0;
+}
+
+const HookStats* Profile::OfHook(std::string_view name) const {
+    const auto it = hooks.find(name);
+    return it == hooks.end() ? nullptr : &it->second;
+}
+
+void Profile::Clear() {
+    opcodes = {};
+    hooks.clear();
+}
+
+void Profile::WriteJson(std::ostream& os) const {
+    os << "{\"opcodes\":{";
+    bool first = true;
+    for (const auto& [code, name] : magic_enum::enum_entries<Opcode>()) {
+        const OpcodeStats& stats = Of(code);
+        if (stats.count == 0) {
+            continue;
+        }
+        os << (first ? "" : ",")
+           << std::format("\"{}\":{{\"count\":{},\"ticks\":{}}}", name, stats.count, stats.ticks);
+        first = false;
+    }
+    os << "},\"hooks\":{";
+    first = true;
+    for (const auto& [name, stats] : hooks) {
+        // hook names are registered by the host, escape what JSON requires
+        std::string escaped;
+        for (const char c : name) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            if (static_cast<unsigned char>(c) < 0x20) {
+                escaped += std::format("\\u{:04x}", c);
+            } else {
+                escaped += c;
+            }
+        }
+        os << (first ? "" : ",")
+           << std::format("\"{}\":{{\"calls\":{},\"nanos\":{},\"latency\":[", escaped, stats.calls, stats.nanos);
+        // trailing empty buckets are left out
+        const std::span<const uint64_t> buckets = stats.latency.Buckets();
+        const auto last = std::find_if(buckets.rbegin(), buckets.rend(), [](uint64_t n) { return n != 0; });
+        for (auto it = buckets.begin(); it != last.base(); it++) {
+            os << (it == buckets.begin() ? "" : ",") << *it;
+        }
+        os << "]}";
+        first = false;
+    }
+    os << "}}";
+}
+
+std::ostream& operator<<(std::ostream& os, const Profile& profile) {
+    os << std::format("{:<12}{:>12}{:>16}{:>12}\n", "opcode", "count", "ticks", "ticks/op");
+    for (const auto& [code, name] : magic_enum::enum_entries<Opcode>()) {
+        const OpcodeStats& stats = profile.Of(code);
+        if (stats.count != 0) {
+            os << std::format("{:<12}{:>12}{:>16}{:>12}\n", name, stats.count, stats.ticks,
+                              stats.ticks / stats.count);
+        }
+    }
+    if (!profile.hooks.empty()) {
+        os << std::format("{:<12}{:>12}{:>16}{:>12}{:>12}\n", "hook", "calls", "ns", "p50 ns", "p99 ns");
+        for (const auto& [name, stats] : profile.hooks) {
+            os << std::format("{:<12}{:>12}{:>16}{:>12}{:>12}\n", name, stats.calls, stats.nanos,
+                              stats.latency.Percentile(0.5), stats.latency.Percentile(0.99));
+        }
+    }
+    return os;
+}
+
+ProfileProbe::~ProfileProbe() {
+    for (size_t i = 0; i < Profile::OPCODES; i++) {
+        profile.opcodes[i].count += opcodes[i].count;
+        profile.opcodes[i].ticks += opcodes[i].ticks;
+    }
+    for (size_t i = 0; i < calls.size(); i++) {
+        if (calls[i].calls == 0) {
+            continue;
+        }
+        HookStats& stats = profile.hooks[std::string(imports[i]->View())];
+        stats.calls += calls[i].calls;
+        stats.nanos += calls[i].nanos;
+        stats.latency.Merge(calls[i].latency);
+    }
+}
+
+};
@@ -0,0 +1,169 @@
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
+
+#include "theatre/scan.hh"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define THEATRE_SCAN_X86 1
+#include <immintrin.h>
+#else
+#define THEATRE_SCAN_X86 0
+#endif
+
+// AVX2 kernels are compiled for that target alone and only called after
+// checking the CPU, which needs GCC or Clang.
+#if THEATRE_SCAN_X86 && (defined(__GNUC__) || defined(__clang__))
+#define THEATRE_SCAN_AVX2 1
+#define THEATRE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define THEATRE_SCAN_AVX2 0
+#endif
+
+namespace theatre {
+
+static bool IsSpace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static bool IsDigit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool IsIdent(unsigned char c) {
+    const unsigned char lower = c | 0x20;
+    return (lower >= 'a' && lower <= 'z') || IsDigit(c) || c == '_';
+}
+
+template <bool (*InClass)(unsigned char)>
+static const char* SkipScalar(const char* begin, const char* end) {
+    while (begin != end && InClass(static_cast<unsigned char>(*begin))) {
+        begin++;
+    }
+    return begin;
+}
+
+#if THEATRE_SCAN_X86
+
+// Signed compares are fine, bytes above 0x7F are negative and in no class.
+static __m128i InRange(__m128i chars, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(low - 1)),
+                         _mm_cmplt_epi8(chars, _mm_set1_epi8(high + 1)));
+}
+
+static __m128i SpaceMask(__m128i chars) {
+    return _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')), InRange(chars, '\t', '\r'));
+}
+
+static __m128i DigitMask(__m128i chars) {
+    return InRange(chars, '0', '9');
+}
+
+static __m128i IdentMask(__m128i chars) {
+    const __m128i letters = InRange(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 'z');
+    return _mm_or_si128(_mm_or_si128(letters, DigitMask(chars)),
+                        _mm_cmpeq_epi8(chars, _mm_set1_epi8('_')));
+}
+
+template <__m128i (*Mask)(__m128i), bool (*InClass)(unsigned char)>
+static const char* SkipSse2(const char* begin, const char* end) {
+    while (end - begin >= 16) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        const uint32_t outside = ~static_cast<uint32_t>(_mm_movemask_epi8(Mask(chars))) & 0xFFFF;
+        if (outside) {
+            return begin + std::countr_zero(outside);
+        }
+        begin += 16;
+    }
+    return SkipScalar<InClass>(begin, end);
+}
+
+#endif
+
+#if THEATRE_SCAN_AVX2
+
+THEATRE_TARGET_AVX2 static __m256i InRange256(__m256i chars, char low, char high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8(low - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), chars));
+}
+
+THEATRE_TARGET_AVX2 static __m256i SpaceMask256(__m256i chars) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')), InRange256(chars, '\t', '\r'));
+}
+
+THEATRE_TARGET_AVX2 static __m256i DigitMask256(__m256i chars) {
+    return InRange256(chars, '0', '9');
+}
+
+THEATRE_TARGET_AVX2 static __m256i IdentMask256(__m256i chars) {
+    const __m256i letters = InRange256(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), 'a', 'z');
+    return _mm256_or_si256(_mm256_or_si256(letters, DigitMask256(chars)),
+                           _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_')));
+}
+
+template <__m256i (*Mask)(__m256i), __m128i (*Mask128)(__m128i), bool (*InClass)(unsigned char)>
+THEATRE_TARGET_AVX2 static const char* SkipAvx2(const char* begin, const char* end) {
+    while (end - begin >= 32) {
+        const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        const uint32_t outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(Mask(chars)));
+        if (outside) {
+            return begin + std::countr_zero(outside);
+        }
+        begin += 32;
+    }
+    return SkipSse2<Mask128, InClass>(begin, end);
+}
+
+#endif
+
+static constexpr ScanKernels SCALAR_KERNELS {
+    ScanLevel::SCALAR, SkipScalar<IsSpace>, SkipScalar<IsIdent>, SkipScalar<IsDigit>
+};
+
+#if THEATRE_SCAN_X86
+static constexpr ScanKernels SSE2_KERNELS {
+    ScanLevel::SSE2,
+    SkipSse2<SpaceMask, IsSpace>, SkipSse2<IdentMask, IsIdent>, SkipSse2<DigitMask, IsDigit>
+};
+#endif
+
+#if THEATRE_SCAN_AVX2
+static constexpr ScanKernels AVX2_KERNELS {
+    ScanLevel::AVX2,
+    SkipAvx2<SpaceMask256, SpaceMask, IsSpace>,
+    SkipAvx2<IdentMask256, IdentMask, IsIdent>,
+    SkipAvx2<DigitMask256, DigitMask, IsDigit>
+};
+#endif
+
+const ScanKernels* ScanKernels::Get(ScanLevel level) {
+    switch (level) {
+        case ScanLevel::SCALAR:
+            return &SCALAR_KERNELS;
+#if THEATRE_SCAN_X86
+        case ScanLevel::SSE2:
+            // part of every x86-64 CPU
+            return &SSE2_KERNELS;
+#endif
+#if THEATRE_SCAN_AVX2
+        case ScanLevel::AVX2:
+            return __builtin_cpu_supports("avx2") ? &AVX2_KERNELS : nullptr;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const ScanKernels& ScanKernels::Best() {
+    static const ScanKernels& best = [] () -> const ScanKernels& {
+        for (const ScanLevel level : { ScanLevel::AVX2, ScanLevel::SSE2 }) {
+            if (const ScanKernels* kernels = Get(level)) {
+                return *kernels;
+            }
+        }
+        return SCALAR_KERNELS;
+    }();
+    return best;
+}
+
+};
@@ -0,0 +1,73 @@
+#include <functional>
+
+#include "theatre/script_cache.hh"
+#include "theatre/optimizer.hh"
+#include "theatre/vm.hh"
+
+namespace theatre {
+
+std::shared_ptr<CompiledScript> Compile(std::string_view script, bool optimize) {
+    const std::vector<Command> commands = ParseScript(script);
+    return std::make_shared<CompiledScript>(CompiledScript{
+        std::string(script), optimize, Assemble(optimize ? Optimize(commands) : commands)
+    });
+}
+
+static uint64_t KeyOf(std::string_view script, bool optimize) {
+    return std::hash<std::string_view>{}(script) ^ static_cast<uint64_t>(optimize);
+}
+
+std::shared_ptr<CompiledScript> ScriptCache::Get(std::string_view script, bool optimize) {
+    const uint64_t key = KeyOf(script, optimize);
+    const auto it = index.find(key);
+    if (it != index.end()) {
+        const std::shared_ptr<CompiledScript>& cached = it->second->script;
+        if (cached->optimized == optimize && cached->source == script) {
+            hits++;
+            entries.splice(entries.begin(), entries, it->second);
+            return cached;
+        }
+        // hash collision, the new script takes its place
+        size -= cached->SizeInBytes();
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    misses++;
+    std::shared_ptr<CompiledScript> compiled = Compile(script, optimize);
+    const size_t bytes = compiled->SizeInBytes();
+    if (bytes <= capacity) {
+        Evict(capacity - bytes);
+        entries.emplace_front(Entry{ key, compiled });
+        index.emplace(key, entries.begin());
+        size += bytes;
+    }
+    return compiled;
+}
+
+void ScriptCache::SetCapacity(size_t bytes) {
+    capacity = bytes;
+    Evict(capacity);
+}
+
+void ScriptCache::Clear() {
+    entries.clear();
+    index.clear();
+    size = 0;
+}
+
+void ScriptCache::Evict(size_t target) {
+    while (size > target && !entries.empty()) {
+        const Entry& last = entries.back();
+        size -= last.script->SizeInBytes();
+        index.erase(last.key);
+        entries.pop_back();
+    }
+}
+
+ScriptCache& ScriptCache::ForThread() {
+    thread_local ScriptCache cache;
+    return cache;
+}
+
+};
@@ -0,0 +1,90 @@
+#include <new>
+#include <cstring>
+
+#include "theatre/strings.hh"
+
+namespace theatre {
+
+StringObject* StringObject::Create(std::string_view text) {
+    // ::operator new is aligned to at least 8 bytes, Value uses the low bits
+    void* memory = ::operator new(sizeof(StringObject) + text.size() + 1);
+    StringObject* str = new (memory) StringObject{ 1, static_cast<uint32_t>(text.size()), nullptr };
+    char* chars = reinterpret_cast<char*>(str + 1);
+    std::memcpy(chars, text.data(), text.size());
+    chars[text.size()] = '\0';
+    return str;
+}
+
+void StringObject::Destroy(StringObject* str) {
+    str->~StringObject();
+    ::operator delete(str);
+}
+
+StringTable::~StringTable() {
+    for (const auto& [view, str]: strings) {
+        StringObject::Destroy(str);
+    }
+}
+
+Symbol StringTable::Intern(std::string_view text) {
+    std::lock_guard lock(mutex);
+    auto it = strings.find(text);
+    if (it != strings.end()) {
+        // shared strings may be counted down concurrently, holders of one
+        // simply stop counting once it is immortal
+        std::atomic_ref<uint32_t>(it->second->refs).store(StringObject::IMMORTAL, std::memory_order_relaxed);
+        return it->second;
+    }
+    StringObject* str = StringObject::Create(text);
+    str->refs = StringObject::IMMORTAL;
+    str->table = this;
+    strings.emplace(str->View(), str);
+    return str;
+}
+
+StringObject* StringTable::Share(std::string_view text) {
+    std::lock_guard lock(mutex);
+    auto it = strings.find(text);
+    if (it != strings.end()) {
+        it->second->Retain();
+        return it->second;
+    }
+    StringObject* str = StringObject::Create(text);
+    str->table = this;
+    strings.emplace(str->View(), str);
+    return str;
+}
+
+void StringTable::Release(StringObject* str) {
+    std::lock_guard lock(mutex);
+    // Share only hands out references under the lock, so once the count
+    // drops to zero here nobody can revive the string
+    std::atomic_ref<uint32_t> count(str->refs);
+    uint32_t current = count.load(std::memory_order_relaxed);
+    while (current != StringObject::IMMORTAL
+           && !count.compare_exchange_weak(current, current - 1, std::memory_order_acq_rel)) {
+    }
+    if (current == 1) {
+        strings.erase(str->View());
+        StringObject::Destroy(str);
+    }
+}
+
+Symbol StringTable::Find(std::string_view text) const {
+    std::lock_guard lock(mutex);
+    auto it = strings.find(text);
+    return it != strings.end() ? it->second : nullptr;
+}
+
+size_t StringTable::Size() const {
+    std::lock_guard lock(mutex);
+    return strings.size();
+}
+
+StringTable& StringTable::Global() {
+    // never destroyed, values may still point into it during static destruction
+    static StringTable* table = new StringTable();
+    return *table;
+}
+
+};
@@ -0,0 +1,129 @@
+#include <format>
+#include <functional>
+
+#include "theatre/value.hh"
+
+namespace theatre {
+
+Value::Value(const Any& any) : Value() {
+    if (any.IsType<int>()) {
+        *this = Int(any.Extract<int>());
+    } else if (any.IsType<float>()) {
+        *this = Float(any.Extract<float>());
+    } else if (any.IsType<bool>()) {
+        *this = Bool(any.Extract<bool>());
+    } else if (any.IsType<std::string>()) {
+        *this = String(std::get<std::string>(any));
+    }
+}
+
+Value Value::String(std::string_view text) {
+    return Value(reinterpret_cast<uintptr_t>(StringObject::Create(text)), AnyType::STRING);
+}
+
+Any Value::ToAny() const {
+    switch (Type()) {
+        case AnyType::INT: return Any(AsInt());
+        case AnyType::FLOAT: return Any(AsFloat());
+        case AnyType::BOOL: return Any(AsBool());
+        case AnyType::STRING: return Any(AsString());
+        default: return Any();
+    }
+}
+
+std::string Value::ToString() const {
+    switch (Type()) {
+        case AnyType::INT: return std::to_string(AsInt());
+        case AnyType::FLOAT: return std::to_string(AsFloat());
+        case AnyType::BOOL: return AsBool() ? "true" : "false";
+        case AnyType::STRING: return std::string(AsString());
+        default: return "(mono)";
+    }
+}
+
+const char* Value::GetTypeName() const {
+    switch (Type()) {
+        case AnyType::INT: return "int";
+        case AnyType::FLOAT: return "float";
+        case AnyType::BOOL: return "bool";
+        case AnyType::STRING: return "string";
+        default: return "mono";
+    }
+}
+
+bool Value::Identical(const Value& o) const {
+    if (bits == o.bits) {
+        // same payload, or the same interned string
+        return true;
+    }
+    if (IsString() && o.IsString()) {
+        return AsString() == o.AsString();
+    }
+    return false;
+}
+
+size_t Value::Hash() const {
+    if (IsString()) {
+        return std::hash<std::string_view>{}(AsString());
+    }
+    return std::hash<uint64_t>{}(bits);
+}
+
+void Value::ThrowNotNumeric() const {
+    throw OperationError(std::format("Any {} does not contain valuable", ToString()));
+}
+
+static void ThrowIfEitherIsString(const Value& a, const Value& b) {
+    // strings not allowed
+    if (a.IsString() || b.IsString()) {
+        throw OperationError("Cannot subtract with strings");
+    }
+}
+
+// If either is float, type gets promoted
+template <typename Op>
+static Value Arithmetic(const Value& a, const Value& b, Op op) {
+    if (a.IsFloat() || b.IsFloat()) {
+        const float left = a.Number<float>();
+        return Value::Float(op(left, b.Number<float>()));
+    }
+    const int left = a.Number<int>();
+    return Value::Int(op(left, b.Number<int>()));
+}
+
+Value operator+(const Value& a, const Value& b) {
+    // string concatenation
+    if (a.IsString() && b.IsString()) {
+        std::string joined;
+        joined.reserve(a.AsString().size() + b.AsString().size());
+        joined.append(a.AsString()).append(b.AsString());
+        return Value::String(joined);
+    }
+    return Arithmetic(a, b, std::plus<>());
+}
+
+Value operator-(const Value& a, const Value& b) {
+    ThrowIfEitherIsString(a, b);
+    return Arithmetic(a, b, std::minus<>());
+}
+
+Value operator*(const Value& a, const Value& b) {
+    ThrowIfEitherIsString(a, b);
+    return Arithmetic(a, b, std::multiplies<>());
+}
+
+Value operator/(const Value& a, const Value& b) {
+    ThrowIfEitherIsString(a, b);
+    return Arithmetic(a, b, std::divides<>());
+}
+
+std::ostream& operator<<(std::ostream& os, const Value& value) {
+    if (value.IsString()) {
+        os << value.AsString();
+    } else {
+        os << value.ToString();
+    }
+    return os;
+}
+
+};
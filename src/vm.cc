@@ -8,393 +8,862 @@
 #include <stdexcept>
 #include <format>
 #include <optional>
-#include <deque>
 #include <unordered_map>
 #include <span>
 #include <cstdio>
+#include <cstring>
 #include <algorithm>
 #include <iterator>
+#include <functional>
+#include <type_traits>
 
 #include "theatre/types.hh"
+#include "theatre/vm.hh"
+#include "theatre/optimizer.hh"
+#include "theatre_script.hh"
 #include "magic_enum.hpp"
 
 namespace theatre {
 
-// Virtual machine and its types' methods should be pure.
-
-using ParseError = std::runtime_error;
-using VmError = std::runtime_error;
-
-enum class Opcode : int
-{
-    PUSH,
-    SUB,
-    MUL,
-    DIV,
-    ADD,
-    CALL,
-};
+const std::shared_ptr<const HookRegistry>& VirtualMachine::StandardLibrary() {
+    static const std::shared_ptr<const HookRegistry> library = [] {
+        auto registry = std::make_shared<HookRegistry>();
+        registry->Register("print", Print, -1);
+        registry->Register("println", PrintLn, -1);
+        registry->Register("throw", Throw, -1);
+        return registry;
+    }();
+    return library;
+}
 
-class Command
+// Contiguous stack that Run() executes on. It is loaded from the persistent
+// stack once per run and only the part above the lowest touched slot is
+// written back, the rest keeps sharing the old nodes.
+class WorkingStack
 {
 public:
-    Opcode code;
-    Any value;
-    
-    friend std::ostream& operator<<(std::ostream& os, const Command& cmd) {
-        os << magic_enum::enum_name<Opcode>(cmd.code) << " " << cmd.value;
-        return os;
+    explicit WorkingStack(const PersistentList<Value>& base) {
+        Rebase(base);
     }
-};
 
-class VirtualMachine;
-struct HookContext {
-    std::ostream& out;
-    const std::span<Any>& args;
-    VirtualMachine& vm;
+    // starts over from the given list
+    void Rebase(const PersistentList<Value>& list) {
+        base = list;
+        items.resize(base.Size());
+        low = base.Size();
+        auto it = items.rbegin();
+        for (const Value& value: base) {
+            *it++ = value;
+        }
+    }
 
-    HookContext(VirtualMachine& vm, const std::span<Any>& args, std::ostream& out)
-        : vm(vm), args(args), out(out)
-        {
+    bool IsEmpty() const {
+        return items.empty();
+    }
+
+    size_t Size() const {
+        return items.size();
+    }
+
+    void Push(const Value& value) {
+        items.emplace_back(value);
+    }
+
+    // the topmost count values, the top of the stack last
+    std::span<const Value> Top(size_t count) const {
+        return std::span<const Value>(items).last(count);
+    }
+
+    // pops the topmost count values at once
+    void Truncate(size_t count) {
+        items.resize(items.size() - count);
+        low = std::min(low, items.size());
+    }
+
+    AnyType TypeAt(size_t depth) const {
+        return items[items.size() - 1 - depth].Type();
+    }
+
+    // Applies op to the two topmost values when both are of the given
+    // numeric type, false leaves the stack untouched.
+    template <AnyType type, typename F>
+    bool ApplyTyped(F op) {
+        const size_t n = items.size();
+        if (n < 2 || !items[n - 1].IsType(type) || !items[n - 2].IsType(type)) {
+            return false;
         }
-};
+        if constexpr (type == AnyType::INT) {
+            items[n - 2] = Value::Int(op(items[n - 1].AsInt(), items[n - 2].AsInt()));
+        } else {
+            items[n - 2] = Value::Float(op(items[n - 1].AsFloat(), items[n - 2].AsFloat()));
+        }
+        items.pop_back();
+        low = std::min(low, n - 2);
+        return true;
+    }
 
-using HookFunc = std::function<Any(HookContext&&)>;
-struct Hook {
-    int argc; // -1 for infinite
-    HookFunc func;
-    std::string name;
-    
-    Any Call(VirtualMachine* vm, const std::span<Any>& args) const;
+    Value Pop() {
+        if (items.empty()) {
+            throw VmError("Stack underflow");
+        }
+        Value value = std::move(items.back());
+        items.pop_back();
+        low = std::min(low, items.size());
+        return value;
+    }
+
+    PersistentList<Value> Persist() const {
+        return Persist(items.size());
+    }
+
+    // Persists all but the topmost count values and continues from that list,
+    // so publishing again only adds what changed since.
+    const PersistentList<Value>& Publish(size_t count) {
+        const size_t size = items.size() - count;
+        base = Persist(size);
+        low = size;
+        return base;
+    }
+
+private:
+    PersistentList<Value> Persist(size_t size) const {
+        PersistentList<Value> list = base;
+        for (size_t i = std::min(low, size); i < base.Size(); i++) {
+            list.Drop();
+        }
+        for (size_t i = std::min(low, size); i < size; i++) {
+            list.Push(items[i]);
+        }
+        return list;
+    }
+
+    PersistentList<Value> base;
+    std::vector<Value> items;
+    size_t low; // items below this index are untouched
 };
 
+// Checks calls against the hooks they resolved to. The types of the values
+// on the stack are followed as far as they are known from the program alone,
+// anything else is checked when the call happens.
+static void CheckCalls(const Bytecode& program, const std::vector<const Hook*>& links) {
+    std::vector<std::optional<AnyType>> known; // top of the stack last, unknown below
+    const auto Pop = [&known](size_t count) {
+        known.resize(known.size() - std::min(count, known.size()));
+    };
+    const auto Check = [&known](const Hook& hook, uint32_t argc) {
+        if (argc != NO_ARGC && hook.argc >= 0 && argc != static_cast<uint32_t>(hook.argc)) {
+            throw VmError(std::format("Function {} expects {} args but {} were given.",
+                                      hook.name, hook.argc, argc));
+        }
+        for (size_t i = 0; i < hook.params.size() && i < known.size(); i++) {
+            const std::optional<AnyType> type = known[known.size() - 1 - i];
+            if (type && !Accepts(hook.params[i], *type)) {
+                ThrowArgumentType(hook.name, i, hook.params[i], *type);
+            }
+        }
+        // hooks eat part of the stack and maybe push a result
+        known.clear();
+    };
 
-class VirtualMachine
-{
-public:
-    VirtualMachine(const std::string& name = "", std::ostream& outStream = std::cout)
-        : name(name), outStream(&outStream)
-    {
-    }
-    
-    void Init() {
-        // add standard library
-        Register("print", Print, -1);
-        Register("println", PrintLn, -1);
-        Register("throw", Throw, -1);
-    }
-
-    [[nodiscard]] VirtualMachine Execute(const Command& cmd) const {
-        VirtualMachine m = *this;
-        
-        switch (cmd.code) {
-            case Opcode::PUSH: {
-                m = m.PushStack(cmd.value);
+    for (Instruction ins: program.code) {
+        switch (OpOf(ins)) {
+            case Op::PUSH_MONO:
+                known.emplace_back(AnyType::MONO);
                 break;
-            }
-            case Opcode::ADD: {
-                EnsureStackLength(2);
-                Any a, b;
-                m = m.PopStack(&a);
-                m = m.PopStack(&b);
-                m = m.PushStack(a + b);
+            case Op::PUSH_INT:
+                known.emplace_back(AnyType::INT);
                 break;
-            }
-            case Opcode::SUB: {
-                EnsureStackLength(2);
-                Any a, b;
-                m = m.PopStack(&a);
-                m = m.PopStack(&b);
-                m = m.PushStack(a - b);
+            case Op::PUSH_CONST:
+                known.emplace_back(program.constants.At(OperandOf(ins)).Type());
                 break;
-            }
-            case Opcode::MUL: {
-                EnsureStackLength(2);
-                Any a, b;
-                m = m.PopStack(&a);
-                m = m.PopStack(&b);
-                m = m.PushStack(a * b);
+            case Op::CALL:
+                Check(*links[FirstOf(ins)], SecondOf(ins));
                 break;
-            }
-            case Opcode::DIV: {
-                EnsureStackLength(2);
-                Any a, b;
-                m = m.PopStack(&a);
-                m = m.PopStack(&b);
-                m = m.PushStack(a / b);
+            case Op::PUSH_CALL:
+                known.emplace_back(program.constants.At(FirstOf(ins)).Type());
+                Check(*links[SecondOf(ins)], NO_ARGC);
                 break;
-            }
-            case Opcode::CALL: {
-                const std::string& func = cmd.value.Extract<std::string>();
-                Hook hook = GetHook(func);
-                // eat rest stack
-                std::vector<Any> args; args.reserve(8);
-                while (!m.IsStackEmpty()) {
-                    Any arg;
-                    m = m.PopStack(&arg);
-                    args.emplace_back(arg);
-                }
-                Any result = hook.Call(&m, args);
-                if (!result.IsMono()) {
-                    m = m.PushStack(result);
-                }
+            case Op::ADD_CONST:
+            case Op::SUB_CONST:
+            case Op::MUL_CONST:
+            case Op::DIV_CONST:
+                Pop(1);
+                known.emplace_back();
+                break;
+            default:
+                // binary arithmetic
+                Pop(2);
+                known.emplace_back();
                 break;
-            }
-            default: {
-                throw VmError(std::format("Opcode {} not implemented.",
-                                          magic_enum::enum_name<Opcode>(cmd.code)));
-            }
         }
-        
-        m.history.emplace_front(cmd);
-        return m;
     }
-    
-    bool IsStackEmpty() const {
-        return stack.empty();
+}
+
+std::shared_ptr<const Linkage> VirtualMachine::Link(Bytecode& program) const {
+    if (program.linkage && program.linkage->registry == registry && program.linkage->overlay == hooks) {
+        // tables are copied before they change while anything shares them
+        return program.linkage;
     }
-    
-    void EnsureStackLength(int argc) const
-    {
-        if (stack.size() < argc) {
-            throw VmError(std::format("Stack underflow. Expected {} items but got {}.",
-                                      argc, stack.size()));
+
+    std::vector<const Hook*> links;
+    links.reserve(program.imports.size());
+    for (Symbol name: program.imports) {
+        const Hook* hook = FindHook(name);
+        if (!hook) {
+            // assembled against another string table
+            hook = FindHook(StringTable::Global().Find(name->View()));
+        }
+        if (!hook) {
+            throw VmError(std::format("No external hook found with name: {}", name->View()));
         }
+        links.emplace_back(hook);
     }
+    CheckCalls(program, links);
+    program.linkage = std::make_shared<const Linkage>(Linkage{ registry, hooks, std::move(links) });
+    return program.linkage;
+}
 
-    [[nodiscard]] VirtualMachine PopStack(Any* outValue) const {
-        if (IsStackEmpty()) {
-            throw VmError("Stack underflow");
-        }
-        VirtualMachine m = *this;
-        Any value = m.stack.back();
-        m.stack.pop_back();
-        *outValue = value;
-        return m;
-    }
-    
-    [[nodiscard]] VirtualMachine PushStack(const Any& value) const {
-        VirtualMachine m = *this;
-        m.stack.emplace_back(value);
-        return m;
-    }
-    
-    friend std::ostream& operator<<(std::ostream& os, const VirtualMachine& vm) {
-        os << "Virtual machine";
-        if (!vm.name.empty()) {
-            os << " - " << vm.name;
-        }
-        os << "\nStack:" << '\n';
-        if (vm.stack.empty()) {
-            os << "(empty)" << '\n';
-        } else {
-            for (const Any& val: vm.stack) {
-                os << "- " << val << '\n';
+void VirtualMachine::Run(Bytecode& program, DispatchMode mode) {
+    // decode operands once so recording an instruction only copies a value
+    std::vector<Value> operands;
+    if (history.IsEnabled()) {
+        operands.reserve(program.code.size());
+        for (Instruction ins: program.code) {
+            switch (OpOf(ins)) {
+                case Op::PUSH_INT:
+                    operands.emplace_back(Value::Int(ImmediateOf(ins)));
+                    break;
+                case Op::CALL:
+                    operands.emplace_back(Value::FromSymbol(program.imports[FirstOf(ins)]));
+                    break;
+                case Op::PUSH_CONST:
+                case Op::ADD_CONST:
+                case Op::SUB_CONST:
+                case Op::MUL_CONST:
+                case Op::DIV_CONST:
+                    operands.emplace_back(program.constants.At(OperandOf(ins)));
+                    break;
+                case Op::PUSH_CALL:
+                    operands.emplace_back(program.constants.At(FirstOf(ins)));
+                    break;
+                default:
+                    operands.emplace_back();
+                    break;
             }
         }
-        os << "\nHistory:" << '\n';
-        if (vm.history.empty()) {
-            os << "(empty)" << '\n';
+    }
+
+    // keeps the linked hooks alive should a hook register hooks itself
+    const std::shared_ptr<const Linkage> linkage = Link(program);
+    const std::vector<const Hook*>& links = linkage->hooks;
+
+    WorkingStack working(stack);
+    const auto DispatchWith = [&](auto& probe) {
+        if (mode == DispatchMode::THREADED && THEATRE_THREADED_DISPATCH) {
+            Dispatch<true>(program, working, operands, links, probe);
         } else {
-            for (const Command& cmd: vm.history) {
-                os << "- " << cmd << '\n';
-            }
+            Dispatch<false>(program, working, operands, links, probe);
         }
-        return os;
+    };
+    try {
+#if THEATRE_PROFILING
+        if (profile) {
+            ProfileProbe probe(*profile, program.imports);
+            DispatchWith(probe);
+        } else
+#endif
+        {
+            NoProbe probe;
+            DispatchWith(probe);
+        }
+    } catch (...) {
+        stack = working.Persist();
+        throw;
+    }
+    stack = working.Persist();
+}
+
+// Rewrites a generic arithmetic instruction into the typed variant matching
+// its two operands. Mixed operand types keep the generic instruction.
+static void Quicken(Instruction* ip, const WorkingStack& stack, Op ints, Op floats, Op strings) {
+    if (stack.Size() < 2 || stack.TypeAt(0) != stack.TypeAt(1)) {
+        return;
     }
-    
-    void Register(const std::string& name, HookFunc func, int paramCount = -1) {
-        hooks[name] = Hook{ paramCount, func };
+    switch (stack.TypeAt(0)) {
+        case AnyType::INT:
+            *ip = Encode(ints);
+            break;
+        case AnyType::FLOAT:
+            *ip = Encode(floats);
+            break;
+        case AnyType::STRING:
+            *ip = Encode(strings);
+            break;
+        default:
+            break;
     }
-    
-    Hook GetHook(const std::string& name) const {
-        try {
-            return hooks.at(name);
-        } catch (std::range_error& ex) {
-            throw(std::format("No external hook found with name: {}", name));
-        }
+}
+
+// Handlers are shared between both dispatch flavours: every handler starts
+// at CASE and ends with NEXT, which either jumps straight to the handler of
+// the next instruction or goes back around the switch.
+#define CASE(OP) case Op::OP: OP_##OP:
+#if THEATRE_THREADED_DISPATCH
+#define DISPATCH() goto *labels[static_cast<uint8_t>(OpOf(*ip))]
+#else
+#define DISPATCH() continue
+#endif
+#define NEXT() \
+    probe.Retire(SourceOpcode(OpOf(*ip))); \
+    if (recording) { \
+        history.Record(SourceOpcode(OpOf(*ip)), operands[ip - begin]); \
+    } \
+    if (++ip == end) { \
+        return; \
+    } \
+    if constexpr (Threaded) { \
+        DISPATCH(); \
+    } else { \
+        continue; \
     }
 
-    inline std::ostream& GetOutStream() {
-        return *outStream;
+#define GENERIC_BINARY(OP, FN, II, FF, SS) \
+    CASE(OP) { \
+        Quicken(ip, stack, Op::II, Op::FF, Op::SS); \
+        ApplyBinary(stack, FN); \
+        NEXT(); \
     }
 
-private:
-    std::string name;
-    std::deque<Command> history{};
-    std::vector<Any> stack{};
-    std::unordered_map<std::string, Hook> hooks;
-    std::ostream* outStream;
+#define CONST_BINARY(OP, FN) \
+    CASE(OP) { \
+        ApplyConstant(stack, program.constants.At(OperandOf(*ip)), FN); \
+        NEXT(); \
+    }
 
-    static Any Throw(HookContext&& ctx) {
-        try {
-            Any base;
-            for (const Any& a: ctx.args) {
-                base = base + a;
+// falls back to the generic op when the guess was wrong
+#define TYPED_BINARY(OP, TYPE, FN, GENERIC) \
+    CASE(OP) { \
+        if (!stack.ApplyTyped<AnyType::TYPE>(FN)) { \
+            *ip = Encode(Op::GENERIC); \
+            ApplyBinary(stack, FN); \
+        } \
+        NEXT(); \
+    }
+
+template <bool Threaded, typename Probe>
+void VirtualMachine::Dispatch(Bytecode& program, WorkingStack& stack,
+                              const std::vector<Value>& operands,
+                              const std::vector<const Hook*>& links, Probe& probe) {
+    Instruction* const begin = program.code.data();
+    Instruction* const end = begin + program.code.size();
+    Instruction* ip = begin;
+    const bool recording = history.IsEnabled();
+
+    if (ip == end) {
+        return;
+    }
+    probe.Start();
+
+#if THEATRE_THREADED_DISPATCH
+    // indexed by Op, keep in declaration order
+    static const void* const labels[] = {
+        &&OP_PUSH_MONO,
+        &&OP_PUSH_INT,
+        &&OP_PUSH_CONST,
+        &&OP_ADD,
+        &&OP_SUB,
+        &&OP_MUL,
+        &&OP_DIV,
+        &&OP_CALL,
+        &&OP_ADD_II,
+        &&OP_ADD_FF,
+        &&OP_ADD_SS,
+        &&OP_SUB_II,
+        &&OP_SUB_FF,
+        &&OP_MUL_II,
+        &&OP_MUL_FF,
+        &&OP_DIV_II,
+        &&OP_DIV_FF,
+        &&OP_ADD_CONST,
+        &&OP_SUB_CONST,
+        &&OP_MUL_CONST,
+        &&OP_DIV_CONST,
+        &&OP_PUSH_CALL,
+    };
+    static_assert(std::size(labels) == magic_enum::enum_count<Op>(), "Dispatch table out of sync with Op");
+
+    if constexpr (Threaded) {
+        DISPATCH();
+    }
+#endif
+
+    for (;;) {
+        switch (OpOf(*ip)) {
+            CASE(PUSH_MONO) {
+                stack.Push(Value());
+                NEXT();
+            }
+            CASE(PUSH_INT) {
+                stack.Push(Value::Int(ImmediateOf(*ip)));
+                NEXT();
             }
-            throw VmError(base.ToString());
-        } catch (OperationError& ex) {
-            std::stringstream ss;
-            ss << "Error: ";
-            for (const Any& a: ctx.args) {
-                ss << a << " ";
+            CASE(PUSH_CONST) {
+                stack.Push(program.constants.At(OperandOf(*ip)));
+                NEXT();
+            }
+            GENERIC_BINARY(ADD, std::plus<>(), ADD_II, ADD_FF, ADD_SS)
+            GENERIC_BINARY(SUB, std::minus<>(), SUB_II, SUB_FF, SUB)
+            GENERIC_BINARY(MUL, std::multiplies<>(), MUL_II, MUL_FF, MUL)
+            GENERIC_BINARY(DIV, std::divides<>(), DIV_II, DIV_FF, DIV)
+            CASE(CALL) {
+                const uint32_t argc = SecondOf(*ip);
+                const uint64_t start = probe.BeginCall();
+                Invoke(stack, *links[FirstOf(*ip)], argc == NO_ARGC ? -1 : static_cast<int>(argc));
+                probe.EndCall(FirstOf(*ip), start);
+                NEXT();
+            }
+            TYPED_BINARY(ADD_II, INT, std::plus<>(), ADD)
+            TYPED_BINARY(ADD_FF, FLOAT, std::plus<>(), ADD)
+            CASE(ADD_SS) {
+                if (stack.Size() < 2 || stack.TypeAt(0) != AnyType::STRING
+                                     || stack.TypeAt(1) != AnyType::STRING) {
+                    *ip = Encode(Op::ADD);
+                }
+                ApplyBinary(stack, std::plus<>());
+                NEXT();
+            }
+            TYPED_BINARY(SUB_II, INT, std::minus<>(), SUB)
+            TYPED_BINARY(SUB_FF, FLOAT, std::minus<>(), SUB)
+            TYPED_BINARY(MUL_II, INT, std::multiplies<>(), MUL)
+            TYPED_BINARY(MUL_FF, FLOAT, std::multiplies<>(), MUL)
+            TYPED_BINARY(DIV_II, INT, std::divides<>(), DIV)
+            TYPED_BINARY(DIV_FF, FLOAT, std::divides<>(), DIV)
+            CONST_BINARY(ADD_CONST, std::plus<>())
+            CONST_BINARY(SUB_CONST, std::minus<>())
+            CONST_BINARY(MUL_CONST, std::multiplies<>())
+            CONST_BINARY(DIV_CONST, std::divides<>())
+            CASE(PUSH_CALL) {
+                stack.Push(program.constants.At(FirstOf(*ip)));
+                const uint64_t start = probe.BeginCall();
+                Invoke(stack, *links[SecondOf(*ip)]);
+                probe.EndCall(SecondOf(*ip), start);
+                NEXT();
+            }
+            default: {
+                throw VmError(std::format("Op {} not implemented.",
+                                          magic_enum::enum_name<Op>(OpOf(*ip))));
             }
-            throw VmError(ss.str());
         }
     }
-    
-    static void _BasePrint(HookContext& ctx) {
-        if (ctx.args.size() == 1) {
-            ctx.out << ctx.args[0];
-        } else {
-            std::string formatted = FormatWithVector(ctx.args[0].ToString(),
-                                                     std::span(ctx.args.begin() + 1, ctx.args.end()));
-            ctx.out << formatted;
+}
+
+#undef CONST_BINARY
+#undef TYPED_BINARY
+#undef GENERIC_BINARY
+#undef NEXT
+#undef DISPATCH
+#undef CASE
+
+VirtualMachine VirtualMachine::Execute(const Command& cmd) const {
+    VirtualMachine m = *this;
+    m.Step(m.stack, cmd);
+    if (m.history.IsEnabled()) {
+        m.history.Record(cmd.code, Value(cmd.value));
+    }
+    return m;
+}
+
+template <typename Stack>
+void VirtualMachine::Step(Stack& stack, const Command& cmd) {
+    switch (cmd.code) {
+        case Opcode::PUSH: {
+            stack.Push(Value(cmd.value));
+            break;
+        }
+        case Opcode::ADD: {
+            ApplyBinary(stack, std::plus<>());
+            break;
+        }
+        case Opcode::SUB: {
+            ApplyBinary(stack, std::minus<>());
+            break;
+        }
+        case Opcode::MUL: {
+            ApplyBinary(stack, std::multiplies<>());
+            break;
+        }
+        case Opcode::DIV: {
+            ApplyBinary(stack, std::divides<>());
+            break;
+        }
+        case Opcode::CALL: {
+            CallHook(stack, Value(cmd.value), cmd.operand.IsMono() ? -1 : cmd.operand.Extract<int>());
+            break;
+        }
+        case Opcode::ADD_CONST: {
+            ApplyConstant(stack, Value(cmd.value), std::plus<>());
+            break;
+        }
+        case Opcode::SUB_CONST: {
+            ApplyConstant(stack, Value(cmd.value), std::minus<>());
+            break;
+        }
+        case Opcode::MUL_CONST: {
+            ApplyConstant(stack, Value(cmd.value), std::multiplies<>());
+            break;
+        }
+        case Opcode::DIV_CONST: {
+            ApplyConstant(stack, Value(cmd.value), std::divides<>());
+            break;
+        }
+        case Opcode::PUSH_CALL: {
+            stack.Push(Value(cmd.value));
+            CallHook(stack, Value(cmd.operand));
+            break;
+        }
+        default: {
+            throw VmError(std::format("Opcode {} not implemented.",
+                                      magic_enum::enum_name<Opcode>(cmd.code)));
         }
     }
-    
-    static Any Print(HookContext&& ctx) {
-        _BasePrint(ctx);
-        return {};
+}
+
+template <typename Stack, typename F>
+void VirtualMachine::ApplyBinary(Stack& stack, F op) {
+    if (stack.Size() < 2) {
+        throw VmError(std::format("Stack underflow. Expected {} items but got {}.",
+                                  2, stack.Size()));
     }
-    
-    static Any PrintLn(HookContext&& ctx) {
-        _BasePrint(ctx);
-        ctx.out << "\n";
-        return {};
+    Value a = stack.Pop();
+    Value b = stack.Pop();
+    stack.Push(op(a, b));
+}
+
+// same as pushing the constant and applying op, minus the push
+template <typename Stack, typename F>
+void VirtualMachine::ApplyConstant(Stack& stack, const Value& constant, F op) {
+    if (stack.IsEmpty()) {
+        throw VmError(std::format("Stack underflow. Expected {} items but got {}.", 2, 1));
     }
-    
-    static std::string FormatWithVector(const std::string& format,
-                                        const std::span<Any>& args) {
-        std::stringstream ss;
-        size_t argIndex = 0;
-
-        for (char ch : format) {
-            if (ch == '{' && argIndex < args.size()) {
-                const Any& arg = args[argIndex++];
-                ss << arg;
-            } else if (ch != '}') {
-                ss << ch;
+    Value b = stack.Pop();
+    stack.Push(op(constant, b));
+}
+
+template <typename Stack>
+void VirtualMachine::CallHook(Stack& stack, const Value& name, int argc) {
+    if (!name.IsString()) {
+        throw OperationError(std::format("Expected type string, but got {}", name.ToString()));
+    }
+    // literals are interned already, anything else has to be looked up
+    const Symbol symbol = name.AsSymbol() ? name.AsSymbol() : StringTable::Global().Find(name.AsString());
+    // keeps the hook alive should it register hooks itself
+    const std::shared_ptr<const HookRegistry> base = registry;
+    const std::shared_ptr<HookRegistry> overlay = hooks;
+    const Hook* hook = FindHook(symbol);
+    if (!hook) {
+        throw VmError(std::format("No external hook found with name: {}", name.AsString()));
+    }
+    Invoke(stack, *hook, argc);
+}
+
+template <typename Stack>
+void VirtualMachine::Invoke(Stack& stack, const Hook& hook, int argc) {
+    // hooks without an arity eat the rest of the stack
+    const size_t count = argc >= 0 ? argc : hook.argc >= 0 ? hook.argc : stack.Size();
+    if (stack.Size() < count) {
+        throw VmError(std::format("Function {} expects {} args but {} were given.",
+                                  hook.name, count, stack.Size()));
+    }
+
+    const auto Call = [&](HookArgs args) {
+        if (!hook.native) {
+            return Value(hook.Call(this, args));
+        }
+        if (static_cast<int>(args.size()) != hook.argc) {
+            throw VmError(std::format("Function {} expects {} args but {} were given.",
+                                      hook.name, hook.argc, args.size()));
+        }
+        return hook.native(hook.target, hook.name, args);
+    };
+
+    Value result;
+    if constexpr (std::is_same_v<Stack, WorkingStack>) {
+        // The arguments are read in place. A HookFunc sees this machine with
+        // its arguments popped, as Execute would show it, and may replace its stack.
+        if (hook.native) {
+            result = Call(HookArgs(stack.Top(count)));
+            stack.Truncate(count);
+        } else {
+            this->stack = stack.Publish(count);
+            const PersistentList<Value> published = this->stack;
+            result = Call(HookArgs(stack.Top(count)));
+            if (this->stack.Shares(published)) {
+                stack.Truncate(count);
+            } else {
+                stack.Rebase(this->stack);
             }
         }
-        return ss.str();
+    } else {
+        // the persistent stack is not contiguous
+        std::vector<Value> args(count);
+        for (auto it = args.rbegin(); it != args.rend(); ++it) {
+            *it = stack.Pop();
+        }
+        result = Call(HookArgs(args));
     }
-};
+    if (!result.IsMono()) {
+        stack.Push(result);
+    }
+}
 
-    Any Hook::Call(VirtualMachine* vm, const std::span<Any>& args) const {
-        if (argc != -1 && args.size() != argc) {
-            throw VmError(std::format("Function {} expects {} args but {} were given.",
-                                      name, argc, args.size()));
-        }\
-        return func(HookContext(*vm, args, vm->GetOutStream()));
+VirtualMachine VirtualMachine::PopStack(Any* outValue) const {
+    if (IsStackEmpty()) {
+        throw VmError("Stack underflow");
     }
+    VirtualMachine m = *this;
+    *outValue = m.stack.Pop().ToAny();
+    return m;
+}
 
-constexpr bool StringsEqualInsensitive(const std::string_view& str1,
-                                       const std::string_view& str2)
-{
-    if (str1.length() != str2.length())
-        return false;
+VirtualMachine VirtualMachine::PushStack(const Any& value) const {
+    VirtualMachine m = *this;
+    m.stack.Push(Value(value));
+    return m;
+}
 
-    for (int i = 0; i < str1.length(); ++i) {
-        if (std::tolower(str1[i]) != std::tolower(str2[i]))
-            return false;
+void VirtualMachine::Register(const std::string& name, HookFunc func, int paramCount) {
+    Register(Hook{ paramCount, std::move(func), name, nullptr, nullptr, {} });
+}
+
+void VirtualMachine::Register(Hook hook) {
+    if (!hooks) {
+        hooks = std::make_shared<HookRegistry>();
+    } else if (hooks.use_count() > 1) {
+        hooks = std::make_shared<HookRegistry>(*hooks);
+    }
+    hooks->Register(std::move(hook));
+}
+
+void HookRegistry::Register(Hook hook) {
+    const Symbol symbol = StringTable::Global().Intern(hook.name);
+    const auto [it, inserted] = indices.try_emplace(symbol, static_cast<uint32_t>(slots.size()));
+    if (inserted) {
+        slots.emplace_back(std::move(hook));
+    } else {
+        slots[it->second] = std::move(hook);
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const VirtualMachine& vm) {
+    os << "Virtual machine";
+    if (!vm.name.empty()) {
+        os << " - " << vm.name;
+    }
+    os << "\nStack:" << '\n';
+    if (vm.stack.IsEmpty()) {
+        os << "(empty)" << '\n';
+    } else {
+        // print from the bottom of the stack
+        std::vector<const Value*> values;
+        values.reserve(vm.stack.Size());
+        for (const Value& val: vm.stack) {
+            values.emplace_back(&val);
+        }
+        for (auto it = values.rbegin(); it != values.rend(); ++it) {
+            os << "- " << **it << '\n';
+        }
     }
+    os << "\nHistory:" << '\n';
+    if (vm.history.IsEmpty()) {
+        os << "(empty)" << '\n';
+    } else {
+        vm.history.ForEach([&](const HistoryEntry& entry) {
+            os << "- " << magic_enum::enum_name<Opcode>(entry.code)
+               << " " << entry.operand << '\n';
+        });
+    }
+    return os;
+}
+
+Any VirtualMachine::Throw(HookContext&& ctx) {
+    try {
+        Value base;
+        for (const Value& a: ctx.args) {
+            base = base + a;
+        }
+        throw VmError(base.ToString());
+    } catch (OperationError& ex) {
+        std::stringstream ss;
+        ss << "Error: ";
+        for (const Value& a: ctx.args) {
+            ss << a << " ";
+        }
+        throw VmError(ss.str());
+    }
+}
+
+void VirtualMachine::_BasePrint(HookContext& ctx) {
+    if (ctx.args.size() == 1) {
+        ctx.out << ctx.args[0];
+    } else {
+        std::string formatted = FormatWithVector(ctx.args[0].ToString(), ctx.args.Skip(1));
+        ctx.out << formatted;
+    }
+}
 
-    return true;
+Any VirtualMachine::Print(HookContext&& ctx) {
+    _BasePrint(ctx);
+    return {};
 }
 
+Any VirtualMachine::PrintLn(HookContext&& ctx) {
+    _BasePrint(ctx);
+    ctx.out << "\n";
+    return {};
+}
+
+std::string VirtualMachine::FormatWithVector(const std::string& format, HookArgs args) {
+    std::stringstream ss;
+    size_t argIndex = 0;
+
+    for (char ch : format) {
+        if (ch == '{' && argIndex < args.size()) {
+            const Value& arg = args[argIndex++];
+            ss << arg;
+        } else if (ch != '}') {
+            ss << ch;
+        }
+    }
+    return ss.str();
+}
+
+    Any Hook::Call(VirtualMachine* vm, HookArgs args) const {
+        if (argc != -1 && static_cast<int>(args.size()) != argc) {
+            throw VmError(std::format("Function {} expects {} args but {} were given.",
+                                      name, argc, args.size()));
+        }
+        return func(HookContext(*vm, args, vm->GetOutStream()));
+    }
+
 // TODO: unit test
 std::optional<Command> ParseLine(const std::string_view& line)
 {
     constexpr const char* TRIMMED = " \t\n\r\f\v";
-    
+
     size_t start = line.find_first_not_of(TRIMMED);
     if (start == std::string_view::npos) {
         return std::nullopt;
     }
 
     size_t end = line.find_last_not_of(TRIMMED);
-    
+
     std::string_view first = std::string_view(line.data() + start, end - start + 1);
     end = first.find_last_not_of(TRIMMED);
-    
+
     std::string_view second = "";
-    
+
     size_t pos = first.find(' ');
     if (pos != std::string::npos) {
         first = std::string_view(line.data() + start, pos);
         second = std::string_view(first.data() + pos + 1, end - pos);
     }
-    
-    // check what opcode to run
-    for (const auto& [code, codeStr] : magic_enum::enum_entries<Opcode>())
-    {
-        if (StringsEqualInsensitive(first, codeStr))
-        {            
-            return Command{ code, Any::Parse(std::string(second)) };
+
+    const std::optional<Opcode> found = FindOpcode(first);
+    if (!found) {
+        throw ParseError(std::format("No opcode with value: {}", first));
+    }
+
+    const Opcode code = *found;
+    if (code == Opcode::CALL) {
+        // optional argument count after the hook name
+        const size_t split = second.find(' ');
+        if (split != std::string_view::npos) {
+            return Command{ code, Any::Parse(second.substr(0, split)),
+                            Any::Parse(second.substr(split + 1)) };
         }
     }
-    throw ParseError(std::format("No opcode with value: {}", first));
+    if (code == Opcode::PUSH_CALL) {
+        // the hook name is the last word, the value may contain spaces
+        const size_t split = second.rfind(' ');
+        if (split == std::string_view::npos) {
+            return Command{ code, Any(), Any::Parse(second) };
+        }
+        return Command{ code, Any::Parse(second.substr(0, split)),
+                        Any::Parse(second.substr(split + 1)) };
+    }
+    return Command{ code, Any::Parse(second), {} };
 }
 
-Any RunScript(const std::string_view& script, std::ostream& target)
+std::vector<Command> ParseScript(std::string_view script)
 {
-    std::istringstream iss(script.data());
-
     std::vector<Command> cmds;
-    cmds.reserve(1024);
-    
-    std::string line;
-    while (std::getline(iss, line)) {
-        std::optional<Command> cmd = ParseLine(line);
+    cmds.reserve(std::count(script.begin(), script.end(), '\n') + 1);
+
+    // lines are sliced straight out of the script, nothing is copied
+    const char* pos = script.data();
+    const char* end = script.data() + script.size();
+    while (pos < end) {
+        const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        const char* lineEnd = newline ? newline : end;
+
+        std::optional<Command> cmd = ParseLine(std::string_view(pos, lineEnd - pos));
         if (cmd.has_value()) {
-            cmds.emplace_back(*cmd);
+            cmds.emplace_back(std::move(*cmd));
         }
+        pos = lineEnd + 1;
     }
-    
+    return cmds;
+}
+
+Any RunScript(CompiledScript& script, std::ostream& target)
+{
     VirtualMachine vm("default", target);
     vm.Init();
-    
-    for (const Command& cmd: cmds) {
-        vm = vm.Execute(cmd);
-    }
-        
+    vm.Run(script.bytecode);
+
     // first item of stack is the result
     // TODO: if multiple items left on stack return it as array
     Any result {};
     if (!vm.IsStackEmpty()) {
-        vm = vm.PopStack(&result);   
+        result = vm.PeekStack();
     }
     return result;
 }
 
+Any RunScript(const std::string_view& script, std::ostream& target, bool optimize)
+{
+    // keep the script alive even if the cache evicts it while running
+    const std::shared_ptr<CompiledScript> compiled = ScriptCache::ForThread().Get(script, optimize);
+    return RunScript(*compiled, target);
+}
+
 void RunRepl()
 {
     std::cout << "Theatre Script REPL" << std::endl;
     std::cout << "TASM mode" << std::endl;
-    
+
     std::string input;
-    
+
     const auto IsCmd = [&](const std::string_view& cmd) {
-        return StringsEqualInsensitive(input, cmd);
+        return EqualsIgnoringCase(input, cmd);
     };
-    
+
     VirtualMachine vm {};
-    
+
     while (!IsCmd("exit") && !IsCmd("quit") && !IsCmd("q")) {
         std::cin.clear();
         std::getline(std::cin, input);
-        
+
         try {
             std::optional<Command> cmd = ParseLine(input);
             if (!cmd.has_value()) {
                 throw ParseError("Empty line");
             }
-            vm = vm.Execute(*cmd);
+            vm.Run({ *cmd });
         } catch (std::exception& ex) {
             std::cerr << ex.what() << '\n';
         }
     }
 }
 
-};
\ No newline at end of file
+};
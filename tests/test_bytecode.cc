@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <iostream>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+TEST(BytecodeTests, PacksImmediates) {
+	const Bytecode program = Assemble(ParseScript("PUSH 5\nPUSH -3\nPUSH\nADD"));
+
+	ASSERT_EQ(program.code.size(), 4);
+	ASSERT_EQ(OpOf(program.code[0]), Op::PUSH_INT);
+	ASSERT_EQ(ImmediateOf(program.code[0]), 5);
+	ASSERT_EQ(OpOf(program.code[2]), Op::PUSH_MONO);
+	ASSERT_EQ(OpOf(program.code[3]), Op::ADD);
+	ASSERT_EQ(program.constants.Size(), 1); // -3 is parsed as a string
+}
+
+TEST(BytecodeTests, DeduplicatesConstants) {
+	const Bytecode program = Assemble(ParseScript(
+		"PUSH 1.5\nPUSH hello\nPUSH 1.5\nPUSH hello\nPUSH 20000000\nCALL print"
+	));
+
+	ASSERT_EQ(program.constants.Size(), 3);
+	ASSERT_EQ(program.code[0], program.code[2]);
+	ASSERT_EQ(program.code[1], program.code[3]);
+	ASSERT_EQ(OpOf(program.code[4]), Op::PUSH_CONST);
+	ASSERT_EQ(program.imports[FirstOf(program.code[5])]->View(), "print");
+}
+
+TEST(BytecodeTests, SmallerThanCommands) {
+	std::vector<Command> commands;
+	for (int i = 0; i < 1000; i++) {
+		commands.emplace_back(Command{ Opcode::PUSH, Any(i) });
+		commands.emplace_back(Command{ Opcode::ADD });
+	}
+	const Bytecode program = Assemble(commands);
+
+	ASSERT_LE(program.SizeInBytes() * 4, commands.size() * sizeof(Command));
+}
+
+TEST(BytecodeTests, RunsLikeCommands) {
+	const std::vector<Command> commands = ParseScript(
+		"PUSH 2.5\nPUSH 4\nMUL\nPUSH 3\nSUB\nPUSH result {}\nCALL print"
+	);
+
+	std::stringstream fromCommands, fromBytecode;
+	VirtualMachine a("a", fromCommands), b("b", fromBytecode);
+	a.Init();
+	b.Init();
+	for (const Command& cmd : commands) {
+		a = a.Execute(cmd);
+	}
+	b.Run(Assemble(commands));
+
+	ASSERT_EQ(fromCommands.str(), fromBytecode.str());
+	ASSERT_EQ(fromBytecode.str(), "result -7.000000");
+}
+
+TEST(BytecodeTests, DispatchModesAgree) {
+	Bytecode program = Assemble(ParseScript(
+		"PUSH 7\nPUSH 2\nDIV\nPUSH 0.5\nADD\nPUSH x={}\nCALL print"
+	));
+	Bytecode copy = program;
+
+	std::stringstream switched, threaded;
+	VirtualMachine a("a", switched), b("b", threaded);
+	a.Init();
+	b.Init();
+	a.SetHistoryMode(HistoryMode::FULL);
+	b.SetHistoryMode(HistoryMode::FULL);
+	a.Run(program, DispatchMode::SWITCH);
+	b.Run(copy, DispatchMode::THREADED);
+
+	ASSERT_EQ(switched.str(), threaded.str());
+	ASSERT_EQ(a.GetHistory().Size(), program.code.size());
+	ASSERT_EQ(b.GetHistory().Size(), program.code.size());
+}
+
+TEST(BytecodeTests, QuickensArithmetic) {
+	Bytecode program = Assemble(ParseScript(
+		"PUSH 2\nPUSH 3\nMUL\nPUSH 1.5\nPUSH 0.5\nADD\nPUSH a\nPUSH b\nADD"
+	));
+
+	VirtualMachine vm;
+	vm.Run(program);
+
+	ASSERT_EQ(OpOf(program.code[2]), Op::MUL_II);
+	ASSERT_EQ(OpOf(program.code[5]), Op::ADD_FF);
+	ASSERT_EQ(OpOf(program.code[8]), Op::ADD_SS);
+
+	VirtualMachine again;
+	again.Run(program);
+	ASSERT_EQ(again.PeekStack().Extract<std::string>(), "ba");
+}
+
+TEST(BytecodeTests, DeoptimizesOnTypeChange) {
+	Bytecode program = Assemble(ParseScript("CALL next\nPUSH 1\nADD"));
+
+	VirtualMachine vm;
+	vm.Register("next", [](HookContext&&) { return Any(2); });
+	vm.Run(program);
+	ASSERT_EQ(vm.PeekStack().Extract<int>(), 3);
+	ASSERT_EQ(OpOf(program.code[2]), Op::ADD_II);
+
+	VirtualMachine other;
+	other.Register("next", [](HookContext&&) { return Any(2.5f); });
+	other.Run(program);
+	ASSERT_EQ(other.PeekStack().Extract<float>(), 3.5f);
+	ASSERT_EQ(OpOf(program.code[2]), Op::ADD);
+}
+
+TEST(BytecodeTests, PacksPushCall) {
+	std::vector<Command> program = ParseScript("PUSH_CALL hello println");
+	Bytecode bytecode = Assemble(program);
+
+	ASSERT_EQ(bytecode.code.size(), 1);
+	ASSERT_EQ(OpOf(bytecode.code[0]), Op::PUSH_CALL);
+	ASSERT_EQ(bytecode.constants.At(FirstOf(bytecode.code[0])).AsString(), "hello");
+	ASSERT_EQ(bytecode.imports[SecondOf(bytecode.code[0])]->View(), "println");
+
+	// constants past the pair operand range fall back to two instructions
+	program.clear();
+	for (int i = 0; i <= static_cast<int>(MAX_PAIR_OPERAND); i++) {
+		program.emplace_back(Command{ Opcode::PUSH, Any(i + 0.5f) });
+	}
+	program.emplace_back(Command{ Opcode::PUSH_CALL, Any("hello"), Any("println") });
+	bytecode = Assemble(program);
+
+	ASSERT_EQ(bytecode.code.size(), program.size() + 1);
+	ASSERT_EQ(OpOf(bytecode.code[bytecode.code.size() - 2]), Op::PUSH_CONST);
+	ASSERT_EQ(OpOf(bytecode.code.back()), Op::CALL);
+	ASSERT_EQ(SecondOf(bytecode.code.back()), NO_ARGC);
+
+	// the fallback call still takes the arity of the hook
+	std::stringstream out;
+	VirtualMachine vm("vm", out);
+	vm.Init();
+	vm.Run(bytecode);
+	ASSERT_EQ(out.str(), "hello\n");
+}
+
+TEST(BytecodeTests, ImportsHooksOnce) {
+	const Bytecode program = Assemble(ParseScript(
+		"CALL print\nPUSH 1\nCALL println\nPUSH 2\nCALL print"
+	));
+
+	ASSERT_EQ(program.imports.size(), 2);
+	ASSERT_EQ(program.code[0], program.code[4]);
+	ASSERT_EQ(FirstOf(program.code[2]), 1);
+	ASSERT_EQ(SecondOf(program.code[2]), NO_ARGC);
+	ASSERT_EQ(SecondOf(Assemble(ParseScript("CALL print 3")).code[0]), 3);
+	ASSERT_THROW(Assemble(ParseScript("CALL 5")), AssembleError);
+	ASSERT_THROW(Assemble(ParseScript("CALL print many")), AssembleError);
+}
+
+TEST(BytecodeTests, FindsMnemonics) {
+	static_assert(FindOpcode("PUSH_CALL") == Opcode::PUSH_CALL);
+	static_assert(FindOpcode("push") == Opcode::PUSH);
+
+	for (const auto& [code, name] : magic_enum::enum_entries<Opcode>()) {
+		ASSERT_EQ(FindOpcode(name), code) << name;
+	}
+	ASSERT_EQ(FindOpcode("Div_Const"), Opcode::DIV_CONST);
+	ASSERT_EQ(FindOpcode("PUS"), std::nullopt);
+	ASSERT_EQ(FindOpcode("PUSHX"), std::nullopt);
+	ASSERT_EQ(FindOpcode(""), std::nullopt);
+	ASSERT_THROW(ParseLine("JUMP 5"), ParseError);
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+static std::filesystem::path TempPath(const char* name) {
+	return std::filesystem::temp_directory_path() / name;
+}
+
+static std::string ReadFile(const std::filesystem::path& path) {
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+static void WriteFile(const std::filesystem::path& path, const std::string& contents) {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out << contents;
+}
+
+static const char* SCRIPT =
+	"PUSH 3\nPUSH 4.5\nADD\nPUSH true\nPUSH\nPUSH 100000000\nPUSH {} {} {} {}\nCALL println\nPUSH_CALL ok print";
+
+TEST(BytecodeFileTests, RoundTrips) {
+	const std::filesystem::path path = TempPath("theatre_round_trip.tbc");
+	const Bytecode source = Assemble(ParseScript(SCRIPT));
+	SaveBytecode(path, source);
+
+	Bytecode loaded = LoadBytecode(path);
+	ASSERT_TRUE(loaded.code.IsBorrowed());
+	ASSERT_EQ(loaded.code.size(), source.code.size());
+	ASSERT_EQ(loaded.constants.Size(), source.constants.Size());
+	ASSERT_EQ(loaded.imports, source.imports);
+
+	std::stringstream expected, actual;
+	VirtualMachine first("test", expected);
+	first.Init();
+	first.Run(Assemble(ParseScript(SCRIPT)));
+	VirtualMachine second("test", actual);
+	second.Init();
+	second.Run(loaded);
+	ASSERT_EQ(actual.str(), expected.str());
+
+	std::filesystem::remove(path);
+}
+
+TEST(BytecodeFileTests, QuickensPrivately) {
+	const std::filesystem::path path = TempPath("theatre_quicken.tbc");
+	SaveBytecode(path, Assemble(ParseScript("PUSH 1\nPUSH 2\nADD")));
+	const std::string before = ReadFile(path);
+
+	Bytecode program = LoadBytecode(path);
+	VirtualMachine vm;
+	vm.Run(program);
+	vm.Run(program);
+
+	ASSERT_EQ(OpOf(program.code[2]), Op::ADD_II);
+	ASSERT_EQ(vm.PeekStack().Extract<int>(), 3);
+	ASSERT_EQ(ReadFile(path), before);
+
+	std::filesystem::remove(path);
+}
+
+TEST(BytecodeFileTests, RejectsBadFiles) {
+	const std::filesystem::path path = TempPath("theatre_bad.tbc");
+	SaveBytecode(path, Assemble(ParseScript("PUSH text\nPUSH 2\nCALL print")));
+	const std::string good = ReadFile(path);
+
+	ASSERT_THROW(LoadBytecode(TempPath("theatre_missing.tbc")), BytecodeFileError);
+
+	WriteFile(path, good.substr(0, 10));
+	ASSERT_THROW(LoadBytecode(path), BytecodeFileError);
+
+	std::string corrupt = good;
+	corrupt[0] = 'X';
+	WriteFile(path, corrupt);
+	ASSERT_THROW(LoadBytecode(path), BytecodeFileError);
+
+	corrupt = good;
+	corrupt[offsetof(TbcHeader, version)] = TBC_VERSION + 1;
+	WriteFile(path, corrupt);
+	ASSERT_THROW(LoadBytecode(path), BytecodeFileError);
+
+	// truncated string section
+	WriteFile(path, good.substr(0, good.size() - 4));
+	ASSERT_THROW(LoadBytecode(path), BytecodeFileError);
+
+	// PUSH_CONST of a constant that does not exist
+	corrupt = good;
+	const Instruction bad = Encode(Op::PUSH_CONST, 7);
+	std::memcpy(corrupt.data() + sizeof(TbcHeader), &bad, sizeof(bad));
+	WriteFile(path, corrupt);
+	ASSERT_THROW(LoadBytecode(path), BytecodeFileError);
+
+	std::filesystem::remove(path);
+}
@@ -1,6 +1,8 @@
+#include <random>
 #include <span>
 #include <gtest/gtest.h>
 #include "theatre/lexer.hh"
+#include "theatre/scan.hh"
 
 using namespace theatre;
 
@@ -81,4 +83,238 @@ TEST(LexerTests, LexFnDeclaration) {
     };
 
     AssertArrays(tokens, expected);
-}
\ No newline at end of file
+}
+
+TEST(LexerTests, KeywordsNeedWholeWords) {
+    const auto tokens = LexText("format integer fn_ mutable return");
+
+    const std::vector<Token> expected = {
+        Token::Of<TokenType::IDENT>("format"),
+        Token::Of<TokenType::IDENT>("integer"),
+        Token::Of<TokenType::IDENT>("fn_"),
+        Token::Of<TokenType::IDENT>("mutable"),
+        Token::Of<TokenType::RETURN>(),
+    };
+
+    AssertArrays(tokens, expected);
+}
+
+TEST(LexerTests, LexLiterals) {
+    const auto tokens = LexText(R"(print("wow!!!", 15, 2.5, x2))");
+
+    const std::vector<Token> expected = {
+        Token::Of<TokenType::IDENT>("print"),
+        Token::Of<TokenType::PAREN_OPEN>(),
+        Token::Of<TokenType::LITERAL>("\"wow!!!\""),
+        Token::Of<TokenType::COMMA>(),
+        Token::Of<TokenType::LITERAL>("15"),
+        Token::Of<TokenType::COMMA>(),
+        Token::Of<TokenType::LITERAL>("2.5"),
+        Token::Of<TokenType::COMMA>(),
+        Token::Of<TokenType::IDENT>("x2"),
+        Token::Of<TokenType::PAREN_CLOSE>(),
+    };
+
+    AssertArrays(tokens, expected);
+}
+
+TEST(LexerTests, TracksPositions) {
+    const auto tokens = LexText("fn a()\n  return b;");
+
+    ASSERT_EQ(tokens[1].row, 1);
+    ASSERT_EQ(tokens[1].col, 4);
+    ASSERT_EQ(tokens[4].row, 2);
+    ASSERT_EQ(tokens[4].col, 3);
+    ASSERT_EQ(tokens[5].col, 10);
+}
+
+TEST(LexerTests, RejectsUnknownCharacters) {
+    ASSERT_THROW(LexText("a = b @ c;"), LexerError);
+    ASSERT_THROW(LexText("print(\"open"), LexerError);
+    ASSERT_THROW(LexText("1."), LexerError);
+    ASSERT_TRUE(LexText(" \n\t ").empty());
+}
+
+TEST(LexerTests, CompactTokensMatchLexText) {
+    const std::string source = "fn takeSum(int a, int b) int {\n    return a + 2.5;\n}\n";
+    const auto tokens = LexText(source);
+    const TokenBuffer buffer(source);
+
+    ASSERT_EQ(buffer.size(), tokens.size());
+    for (size_t i = 0; i < tokens.size(); i++) {
+        const Token expanded = buffer.Expand(buffer[i]);
+        ASSERT_EQ(expanded, tokens[i]) << i;
+        ASSERT_EQ(expanded.row, tokens[i].row) << i;
+        ASSERT_EQ(expanded.col, tokens[i].col) << i;
+    }
+    ASSERT_TRUE(buffer[0].IsType(TokenType::FN));
+    ASSERT_EQ(buffer.Text(buffer[1]), "takeSum");
+}
+
+TEST(LexerTests, CompactTokensKeepLongIdentifiers) {
+    const std::string ident(100, 'x');
+    const TokenBuffer buffer(ident + " = 1;");
+
+    ASSERT_EQ(buffer.Text(buffer[0]), ident);
+    ASSERT_EQ(buffer.Position(buffer[1]).col, 102);
+}
+
+TEST(LexerTests, ScanKernelsAgree) {
+    // runs crossing the 16 and 32 byte blocks, ending in every class
+    std::string text;
+    for (int i = 0; i < 200; i++) {
+        text += std::string(i % 37, " \t\n\r"[i % 4]);
+        text += std::string(i % 41, "aZ_9"[i % 4]);
+        text += "0123456789"[i % 10];
+        text += "+\"\xC3\xA9("[i % 4];
+    }
+    const ScanKernels& scalar = *ScanKernels::Get(ScanLevel::SCALAR);
+
+    for (const ScanLevel level : { ScanLevel::SSE2, ScanLevel::AVX2 }) {
+        const ScanKernels* kernels = ScanKernels::Get(level);
+        if (!kernels) {
+            continue;
+        }
+        const char* end = text.data() + text.size();
+        for (const char* it = text.data(); it != end; it++) {
+            ASSERT_EQ(kernels->skipSpace(it, end), scalar.skipSpace(it, end));
+            ASSERT_EQ(kernels->skipIdent(it, end), scalar.skipIdent(it, end));
+            ASSERT_EQ(kernels->skipDigits(it, end), scalar.skipDigits(it, end));
+        }
+    }
+    ASSERT_NE(ScanKernels::Get(ScanKernels::Best().level), nullptr);
+}
+
+TEST(LexerTests, LongRuns) {
+    const std::string ident(100, 'x');
+    const auto tokens = LexText("\n\n" + std::string(50, ' ') + ident + "  \t  1234567890123456789012345678901234.5\n  \n z");
+
+    ASSERT_EQ(tokens.size(), 3);
+    ASSERT_EQ(tokens[0].row, 3);
+    ASSERT_EQ(tokens[0].col, 51);
+    ASSERT_EQ(tokens[1].col, 156);
+    ASSERT_EQ(std::string_view(tokens[1].value), "1234567890123456789012345678901234.5");
+    ASSERT_EQ(tokens[2].row, 5);
+    ASSERT_EQ(tokens[2].col, 2);
+}
+
+TEST(LexerTests, StreamsAcrossChunks) {
+    // every chunk size splits some token, string, float or line break
+    const std::string source = "fn takeSum(int a, int b) int {\n    print(\"a b\", 12.75);\n    return a + b;\n}\nformat";
+    const auto tokens = LexText(source);
+
+    for (const size_t chunkSize : { 1, 2, 3, 5, 7, 64 }) {
+        std::istringstream in(source);
+        TokenStream stream(ReadChunks(in), chunkSize);
+        size_t i = 0;
+        for (const Token& token : stream) {
+            ASSERT_LT(i, tokens.size());
+            ASSERT_EQ(token, tokens[i]) << chunkSize << ' ' << i;
+            ASSERT_EQ(token.row, tokens[i].row) << chunkSize << ' ' << i;
+            ASSERT_EQ(token.col, tokens[i].col) << chunkSize << ' ' << i;
+            i++;
+        }
+        ASSERT_EQ(i, tokens.size()) << chunkSize;
+        ASSERT_FALSE(stream.Next().has_value());
+    }
+}
+
+TEST(LexerTests, StreamsInBoundedMemory) {
+    std::string source;
+    while (source.size() < (1 << 20)) {
+        source += "mut float offset = a * b - 2.5;\n";
+    }
+    std::istringstream in(source);
+    TokenStream stream(ReadChunks(in), 256);
+
+    size_t count = 0;
+    size_t window = 0;
+    while (std::optional<Token> token = stream.Next()) {
+        count++;
+        window = std::max(window, stream.WindowSize());
+    }
+    ASSERT_EQ(count, source.size() / 32 * 10);
+    ASSERT_LT(window, 1024);
+}
+
+TEST(LexerTests, StreamsReportErrors) {
+    for (const std::string source : { "a = b @ c;", "print(\"open", "x = 1." }) {
+        std::istringstream in(source);
+        TokenStream stream(ReadChunks(in), 2);
+        ASSERT_THROW(while (stream.Next()) {}, LexerError) << source;
+    }
+}
+
+// Source() closes the gap of the edited buffer, only compare it when asked to
+static void AssertSameBuffers(const TokenBuffer& edited, const TokenBuffer& lexed, bool source)
+{
+    ASSERT_EQ(edited.size(), lexed.size());
+    for (size_t i = 0; i < lexed.size(); i++) {
+        ASSERT_EQ(edited.Text(edited[i]), lexed.Text(lexed[i])) << i;
+        ASSERT_EQ(edited[i].offset, lexed[i].offset) << i;
+        ASSERT_EQ(edited[i].length, lexed[i].length) << i;
+        ASSERT_EQ(edited[i].Type(), lexed[i].Type()) << i;
+        ASSERT_EQ(edited.Position(edited[i]).row, lexed.Position(lexed[i]).row) << i;
+        ASSERT_EQ(edited.Position(edited[i]).col, lexed.Position(lexed[i]).col) << i;
+    }
+    if (source) {
+        ASSERT_EQ(edited.Source(), lexed.Source());
+    }
+}
+
+TEST(LexerTests, EditsMatchLexingAgain) {
+    const std::array<std::string_view, 12> snippets = {
+        "", " ", "\n", "x", "1", ".5", "fn", "return", "(a, b)", "\"str\"", "\n  int y = 2;\n", "+",
+    };
+    std::string source = "fn takeSum(int a, int b) int {\n    print(\"a b\", 12.75);\n    return a + b;\n}\n";
+    TokenBuffer buffer(source);
+    std::mt19937 random(24);
+
+    for (int i = 0; i < 500; i++) {
+        const size_t offset = random() % (source.size() + 1);
+        const size_t removed = std::min<size_t>(random() % 4, source.size() - offset);
+        const std::string_view inserted = snippets[random() % snippets.size()];
+
+        std::string edited = source;
+        edited.replace(offset, removed, inserted);
+        std::optional<TokenBuffer> lexed;
+        try {
+            lexed.emplace(edited);
+        } catch (const LexerError&) {
+        }
+
+        if (!lexed) {
+            ASSERT_THROW(buffer.Edit({ offset, removed, inserted }), LexerError);
+            AssertSameBuffers(buffer, TokenBuffer(source), i % 32 == 0);
+            continue;
+        }
+        buffer.Edit({ offset, removed, inserted });
+        source = edited;
+        AssertSameBuffers(buffer, *lexed, i % 32 == 0);
+    }
+}
+
+TEST(LexerTests, EditsRelexOnlyTheChangedTokens) {
+    std::string source;
+    for (int i = 0; i < 1000; i++) {
+        source += "mut float offset = a * b - 2.5;\n";
+    }
+    TokenBuffer buffer(source);
+
+    // a rename in the middle, then a new line of tokens
+    const size_t line = 500 * 32;
+    TokenSplice splice = buffer.Edit({ line + 10, 6, "shift" });
+    ASSERT_EQ(splice.first, 500 * 10 + 1);
+    ASSERT_EQ(splice.removed, 2);
+    ASSERT_EQ(splice.inserted, 2);
+    ASSERT_EQ(buffer.Text(buffer[500 * 10 + 2]), "shift");
+
+    splice = buffer.Edit({ line, 0, "int y = 1;\n" });
+    ASSERT_LE(splice.removed, 2);
+    ASSERT_EQ(splice.inserted, splice.removed + 5);
+    const CompactToken& last = buffer[buffer.size() - 1];
+    ASSERT_EQ(buffer.Position(last).row, 1001);
+    ASSERT_EQ(buffer.Position(last).col, 31);
+
+    ASSERT_THROW(buffer.Edit({ buffer.Source().size() + 1, 0, "x" }), LexerError);
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <iostream>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+static float Lerp(float a, float b, float t) {
+	return a + (b - a) * t;
+}
+
+TEST(NativeTests, BindsFunctions) {
+	VirtualMachine vm;
+	vm.Bind("lerp", Lerp);
+
+	// the first parameter is the top of the stack
+	vm.Run(ParseScript("PUSH 0.5\nPUSH 20\nPUSH 10\nCALL lerp"));
+
+	ASSERT_STREQ(vm.PeekStack().GetTypeName(), "float");
+	ASSERT_FLOAT_EQ(vm.PeekStack().Extract<float>(), 15.0f);
+}
+
+TEST(NativeTests, BindsLambdas) {
+	std::stringstream out;
+	VirtualMachine vm("test", out);
+	vm.Bind("repeat", [](std::string_view text, int count) {
+		std::string result;
+		for (int i = 0; i < count; i++) {
+			result.append(text);
+		}
+		return result;
+	});
+	vm.Bind("nothing", +[](const Value&) {});
+
+	vm.Run(ParseScript("PUSH 3\nPUSH ab\nCALL repeat\nPUSH 1\nCALL nothing"));
+
+	ASSERT_EQ(vm.PeekStack().Extract<std::string>(), "ababab");
+	ASSERT_EQ(vm.GetHook("repeat").argc, 2);
+}
+
+TEST(NativeTests, ExecuteCallsNatives) {
+	VirtualMachine vm;
+	vm.Bind("lerp", Lerp);
+
+	for (const Command& cmd : ParseScript("PUSH 1.0\nPUSH 3\nPUSH 1\nCALL lerp")) {
+		vm = vm.Execute(cmd);
+	}
+
+	ASSERT_FLOAT_EQ(vm.PeekStack().Extract<float>(), 3.0f);
+}
+
+TEST(NativeTests, RejectsKnownTypesAtLoad) {
+	VirtualMachine vm;
+	vm.Bind("lerp", Lerp);
+
+	try {
+		vm.Run(ParseScript("PUSH 0.5\nPUSH text\nPUSH 10\nCALL lerp"));
+		FAIL() << "Expected the program to be rejected";
+	} catch (ArgumentError& ex) {
+		ASSERT_STREQ(ex.what(), "Function lerp expects float for argument 1 but got string.");
+	}
+	ASSERT_TRUE(vm.IsStackEmpty());
+
+	ASSERT_THROW(vm.Run(ParseScript("PUSH 1\nPUSH 2\nCALL lerp 2")), VmError);
+	ASSERT_TRUE(vm.IsStackEmpty());
+}
+
+TEST(NativeTests, RejectsUnknownTypesWhenCalled) {
+	VirtualMachine vm;
+	vm.Bind("lerp", Lerp);
+	vm.Register("name", [](HookContext&&) { return Any("text"); });
+
+	const std::vector<Command> program = ParseScript("CALL name\nPUSH 1\nPUSH 2\nCALL lerp");
+	ASSERT_THROW(vm.Run(program), ArgumentError);
+}
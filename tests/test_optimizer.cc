@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <iostream>
+
+#include "theatre_script.hh"
+#include "vm_scripts.hh"
+
+using namespace theatre;
+
+static std::string Listing(const std::vector<Command>& program) {
+	std::stringstream ss;
+	for (const Command& cmd : program) {
+		ss << cmd << '\n';
+	}
+	return ss.str();
+}
+
+TEST(OptimizerTests, FoldsConstants) {
+	const std::vector<Command> program = Optimize(ParseScript(
+		"PUSH 2\nPUSH 3\nMUL\nPUSH 4\nADD\nPUSH 1.5\nMUL"
+	));
+
+	ASSERT_EQ(Listing(program), "PUSH 15.000000\n");
+}
+
+TEST(OptimizerTests, FoldsStrings) {
+	const std::vector<Command> program = Optimize(ParseScript(
+		"PUSH world\nPUSH hello\nADD\nCALL print"
+	));
+
+	ASSERT_EQ(Listing(program), "PUSH_CALL helloworld print\n");
+}
+
+TEST(OptimizerTests, LeavesErrorsToRuntime) {
+	const std::vector<Command> program = Optimize(ParseScript(
+		"PUSH 0\nPUSH 5\nDIV\nPUSH text\nPUSH 1\nSUB"
+	), { .fuse = false });
+
+	ASSERT_EQ(program.size(), 6);
+}
+
+TEST(OptimizerTests, FusesConstantOperands) {
+	const std::vector<Command> program = Optimize(ParseScript(
+		"CALL random\nPUSH 2\nMUL\nPUSH 3\nADD"
+	));
+
+	ASSERT_EQ(Listing(program), "CALL random\nMUL_CONST 2\nADD_CONST 3\n");
+
+	VirtualMachine vm;
+	vm.Register("random", [](HookContext&&) { return Any(4); });
+	vm.Run(program);
+	ASSERT_EQ(vm.PeekStack().Extract<int>(), 11);
+}
+
+TEST(OptimizerTests, FusesPushCall) {
+	const std::vector<Command> program = Optimize(ParseScript(
+		"PUSH 3\nPUSH 4\nADD\nPUSH Sum is: {}\nCALL print"
+	));
+
+	ASSERT_EQ(Listing(program), "PUSH 7\nPUSH_CALL Sum is: {} print\n");
+	ASSERT_EQ(Listing(ParseScript("PUSH_CALL Sum is: {} print")), "PUSH_CALL Sum is: {} print\n");
+
+	std::stringstream out;
+	VirtualMachine vm("test", out);
+	vm.Init();
+	vm.Run(program);
+	ASSERT_EQ(out.str(), "Sum is: 7");
+}
+
+TEST(OptimizerTests, ProfilesPairs) {
+	const std::vector<Command> program = ParseScript(
+		"PUSH 1\nPUSH 2\nADD\nPUSH 3\nADD\nPUSH x\nCALL print"
+	);
+
+	PairProfile profile;
+	profile.Add(program);
+	profile.Add(program);
+
+	ASSERT_EQ(profile.Total(), 12);
+	ASSERT_EQ(profile.Count(Opcode::PUSH, Opcode::ADD), 4);
+	ASSERT_EQ(profile.Count(Opcode::ADD, Opcode::PUSH), 4);
+
+	const std::vector<OpcodePair> top = profile.MostFrequent(2);
+	ASSERT_EQ(top.size(), 2);
+	ASSERT_EQ(top[0].first, Opcode::PUSH);
+	ASSERT_EQ(top[0].second, Opcode::ADD);
+	ASSERT_EQ(top[1].first, Opcode::ADD);
+	ASSERT_EQ(top[1].second, Opcode::PUSH);
+
+	PairProfile optimized;
+	optimized.Add(Optimize(program));
+	ASSERT_EQ(optimized.Total(), 1);
+	ASSERT_EQ(optimized.Count(Opcode::PUSH, Opcode::PUSH_CALL), 1);
+}
+
+TEST(OptimizerTests, RemovesIdentities) {
+	const std::vector<Command> program = Optimize(ParseScript(
+		"PUSH 5\nPUSH 0\nADD\nPUSH 1\nMUL\nPUSH 1.5\nPUSH 0\nADD"
+	), { .foldConstants = false, .fuse = false });
+
+	ASSERT_EQ(Listing(program), "PUSH 5\nPUSH 1.500000\nPUSH 0\nADD (mono)\n");
+}
+
+TEST(OptimizerTests, CanBeDisabled) {
+	const std::vector<Command> source = ParseScript("PUSH 2\nPUSH 3\nADD\nPUSH 0\nADD");
+	const std::vector<Command> program = Optimize(source, {
+		.foldConstants = false, .removeNoops = false, .fuse = false
+	});
+
+	ASSERT_EQ(Listing(program), Listing(source));
+}
+
+TEST(OptimizerTests, ExecuteMatchesRun) {
+	const std::vector<Command> program = ParseScript("PUSH 7\nSUB_CONST 2\nDIV_CONST 20");
+
+	VirtualMachine pure;
+	for (const Command& cmd : program) {
+		pure = pure.Execute(cmd);
+	}
+	VirtualMachine inPlace;
+	inPlace.Run(program);
+
+	ASSERT_EQ(pure.PeekStack().Extract<int>(), -4);
+	ASSERT_EQ(inPlace.PeekStack().Extract<int>(), -4);
+}
+
+// programs that only partially fold, on top of the VmTests ones
+static const char* PARTIAL_FOLD_SCRIPTS[] = {
+	"PUSH 3\nPUSH 4\nADD\nPUSH {} + {}\nCALL println\nPUSH 2.5\nPUSH 2\nMUL\nPUSH 1\nADD",
+	"PUSH b\nPUSH a\nADD\nPUSH 0\nADD",
+	"PUSH 1\nPUSH 2\nPUSH 3\nPUSH 4\nSUB\nMUL\nDIV",
+};
+
+static void AssertSameResults(const char* script) {
+	std::stringstream plainOut, optimizedOut;
+	std::string plainError, optimizedError;
+	Any plain, optimized;
+	try {
+		plain = RunScript(script, plainOut, false);
+	} catch (std::exception& ex) {
+		plainError = ex.what();
+	}
+	try {
+		optimized = RunScript(script, optimizedOut, true);
+	} catch (std::exception& ex) {
+		optimizedError = ex.what();
+	}
+
+	ASSERT_EQ(plain.ToString(), optimized.ToString()) << script;
+	ASSERT_STREQ(plain.GetTypeName(), optimized.GetTypeName()) << script;
+	ASSERT_EQ(plainOut.str(), optimizedOut.str()) << script;
+	ASSERT_EQ(plainError, optimizedError) << script;
+}
+
+TEST(OptimizerTests, MatchesUnoptimizedVmTests) {
+	for (const char* script : VM_TEST_SCRIPTS) {
+		AssertSameResults(script);
+	}
+	for (const char* script : PARTIAL_FOLD_SCRIPTS) {
+		AssertSameResults(script);
+	}
+}
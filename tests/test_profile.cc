@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <iostream>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+TEST(ProfileTests, OffByDefault) {
+	VirtualMachine vm;
+	vm.Run(ParseScript("PUSH 1\nPUSH 2\nADD"));
+
+	ASSERT_EQ(vm.GetProfile(), nullptr);
+}
+
+TEST(ProfileTests, CountsOpcodes) {
+	if (!THEATRE_PROFILING) {
+		GTEST_SKIP() << "Built without THEATRE_PROFILING";
+	}
+	VirtualMachine vm;
+	vm.SetProfiling(true);
+
+	// ADD is quickened on the first run, it still counts as ADD
+	Bytecode program = Assemble(ParseScript("PUSH 1\nPUSH 2\nADD\nPUSH 3\nMUL"));
+	vm.Run(program);
+	vm.Run(program);
+
+	const std::shared_ptr<const Profile> profile = vm.GetProfile();
+	ASSERT_EQ(profile->Of(Opcode::PUSH).count, 6);
+	ASSERT_EQ(profile->Of(Opcode::ADD).count, 2);
+	ASSERT_EQ(profile->Of(Opcode::MUL).count, 2);
+	ASSERT_EQ(profile->Of(Opcode::CALL).count, 0);
+	ASSERT_TRUE(profile->Hooks().empty());
+}
+
+TEST(ProfileTests, TimesHooks) {
+	if (!THEATRE_PROFILING) {
+		GTEST_SKIP() << "Built without THEATRE_PROFILING";
+	}
+	std::stringstream out;
+	VirtualMachine vm("test", out);
+	vm.Init();
+	vm.SetProfiling(true);
+
+	vm.Run(ParseScript("PUSH a\nCALL print\nPUSH_CALL b print\nPUSH c\nCALL println"));
+
+	const std::shared_ptr<const Profile> profile = vm.GetProfile();
+	ASSERT_EQ(profile->Of(Opcode::CALL).count, 2);
+	ASSERT_EQ(profile->Of(Opcode::PUSH_CALL).count, 1);
+	ASSERT_EQ(profile->OfHook("print")->calls, 2);
+	ASSERT_EQ(profile->OfHook("print")->latency.Count(), 2);
+	ASSERT_EQ(profile->OfHook("println")->calls, 1);
+	ASSERT_EQ(profile->OfHook("throw"), nullptr);
+	ASSERT_GE(profile->OfHook("print")->latency.Percentile(1.0), profile->OfHook("print")->latency.Percentile(0.0));
+
+	std::stringstream text, json;
+	text << *profile;
+	profile->WriteJson(json);
+	ASSERT_NE(text.str().find("PUSH_CALL"), std::string::npos);
+	ASSERT_EQ(json.str().rfind("{\"opcodes\":{\"PUSH\":{\"count\":2,", 0), 0) << json.str();
+	ASSERT_NE(json.str().find("\"println\":{\"calls\":1,"), std::string::npos) << json.str();
+}
+
+TEST(ProfileTests, CopiesShareTheProfile) {
+	if (!THEATRE_PROFILING) {
+		GTEST_SKIP() << "Built without THEATRE_PROFILING";
+	}
+	VirtualMachine base;
+	base.SetProfiling(true);
+
+	VirtualMachine copy = base;
+	copy.Run(ParseScript("PUSH 1"));
+	base.Run(ParseScript("PUSH 1"));
+
+	ASSERT_EQ(base.GetProfile()->Of(Opcode::PUSH).count, 2);
+
+	base.SetProfiling(false);
+	ASSERT_EQ(base.GetProfile(), nullptr);
+	ASSERT_EQ(copy.GetProfile()->Of(Opcode::PUSH).count, 2);
+}
+
+TEST(ProfileTests, HistogramBuckets) {
+	LatencyHistogram histogram;
+	histogram.Add(0);
+	histogram.Add(3);
+	histogram.Add(3);
+	histogram.Add(1000);
+
+	ASSERT_EQ(histogram.Count(), 4);
+	ASSERT_EQ(histogram.Buckets()[0], 1);
+	ASSERT_EQ(histogram.Buckets()[2], 2);
+	ASSERT_EQ(histogram.Buckets()[10], 1);
+	ASSERT_EQ(histogram.Percentile(0.5), 4);
+	ASSERT_EQ(histogram.Percentile(1.0), 1024);
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <iostream>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+TEST(ScriptCacheTests, CountsHitsAndMisses) {
+	ScriptCache cache;
+
+	const std::shared_ptr<CompiledScript> first = cache.Get("PUSH 5\nPUSH 7\nADD");
+	const std::shared_ptr<CompiledScript> second = cache.Get("PUSH 5\nPUSH 7\nADD");
+	cache.Get("PUSH 1");
+
+	ASSERT_EQ(first, second);
+	ASSERT_EQ(cache.Hits(), 1);
+	ASSERT_EQ(cache.Misses(), 2);
+	ASSERT_EQ(cache.Size(), 2);
+	ASSERT_EQ(cache.SizeInBytes(), first->SizeInBytes() + cache.Get("PUSH 1")->SizeInBytes());
+}
+
+TEST(ScriptCacheTests, KeysOnOptimization) {
+	ScriptCache cache;
+
+	const std::shared_ptr<CompiledScript> optimized = cache.Get("PUSH 2\nPUSH 3\nMUL", true);
+	const std::shared_ptr<CompiledScript> plain = cache.Get("PUSH 2\nPUSH 3\nMUL", false);
+
+	ASSERT_NE(optimized, plain);
+	ASSERT_EQ(optimized->bytecode.code.size(), 1);
+	ASSERT_EQ(plain->bytecode.code.size(), 3);
+	ASSERT_EQ(cache.Misses(), 2);
+}
+
+TEST(ScriptCacheTests, EvictsLeastRecentlyUsed) {
+	const size_t scriptSize = Compile("PUSH 1")->SizeInBytes();
+	ScriptCache cache(scriptSize * 2);
+
+	cache.Get("PUSH 1");
+	cache.Get("PUSH 2");
+	cache.Get("PUSH 1");
+	cache.Get("PUSH 3"); // evicts PUSH 2
+
+	ASSERT_EQ(cache.Size(), 2);
+	cache.Get("PUSH 1");
+	ASSERT_EQ(cache.Hits(), 2);
+	cache.Get("PUSH 2");
+	ASSERT_EQ(cache.Misses(), 4);
+
+	cache.SetCapacity(scriptSize);
+	ASSERT_EQ(cache.Size(), 1);
+	cache.Get("PUSH 2");
+	ASSERT_EQ(cache.Hits(), 3);
+
+	cache.Clear();
+	ASSERT_EQ(cache.Size(), 0);
+	ASSERT_EQ(cache.SizeInBytes(), 0);
+}
+
+TEST(ScriptCacheTests, SkipsOversizedScripts) {
+	ScriptCache cache(1);
+
+	const std::shared_ptr<CompiledScript> script = cache.Get("PUSH 1");
+
+	ASSERT_NE(script, nullptr);
+	ASSERT_EQ(cache.Size(), 0);
+	ASSERT_EQ(cache.SizeInBytes(), 0);
+}
+
+TEST(ScriptCacheTests, RunScriptReusesCompiledScripts) {
+	ScriptCache& cache = ScriptCache::ForThread();
+	cache.Clear();
+	const size_t hits = cache.Hits();
+
+	for (int i = 0; i < 3; i++) {
+		std::stringstream out;
+		ASSERT_EQ(RunScript("PUSH 3\nPUSH 4\nADD\nPUSH {}\nCALL print\nPUSH 1", out).Extract<int>(), 1);
+		ASSERT_EQ(out.str(), "7");
+	}
+
+	ASSERT_EQ(cache.Hits(), hits + 2);
+	ASSERT_EQ(cache.Size(), 1);
+}
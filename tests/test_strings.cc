@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <iostream>
+
+#include "theatre_script.hh"
+
+using namespace theatre;
+
+TEST(StringTests, InternsOnce) {
+	StringTable table;
+	const Symbol a = table.Intern("hello");
+	const Symbol b = table.Intern(std::string("hel") + "lo");
+
+	ASSERT_EQ(a, b);
+	ASSERT_EQ(a->View(), "hello");
+	ASSERT_EQ(table.Size(), 1);
+	ASSERT_EQ(table.Find("hello"), a);
+	ASSERT_EQ(table.Find("world"), nullptr);
+}
+
+TEST(StringTests, InternedValuesAreImmortal) {
+	StringTable table;
+	const Value literal = Value::Interned("literal", table);
+	{
+		Value copy = literal;
+		ASSERT_EQ(copy.Bits(), literal.Bits());
+		ASSERT_EQ(copy.AsSymbol(), table.Find("literal"));
+	}
+	ASSERT_TRUE(literal.AsSymbol()->IsInterned());
+	ASSERT_EQ(Value::String("runtime").AsSymbol(), nullptr);
+}
+
+TEST(StringTests, ProgramsShareLiterals) {
+	StringTable table;
+	{
+		VirtualMachine vm;
+		{
+			Bytecode first = Assemble(ParseScript("PUSH some literal\nPUSH some literal"), table);
+			const Bytecode second = Assemble(ParseScript("PUSH some literal"), table);
+			ASSERT_EQ(first.constants.Size(), 1);
+			ASSERT_EQ(first.constants.At(0).AsSymbol(), table.Find("some literal"));
+			ASSERT_EQ(first.constants.At(0).AsSymbol(), second.constants.At(0).AsSymbol());
+			vm.Run(first);
+		}
+		// the programs are gone, the values they pushed are not
+		ASSERT_EQ(vm.PeekStack().Extract<std::string>(), "some literal");
+		ASSERT_NE(table.Find("some literal"), nullptr);
+	}
+	ASSERT_EQ(table.Find("some literal"), nullptr);
+	ASSERT_EQ(table.Size(), 0);
+}
+
+TEST(StringTests, InterningMakesSharedStringsImmortal) {
+	StringTable table;
+	{
+		const Value shared = Value::Shared("print", table);
+		ASSERT_EQ(table.Intern("print"), shared.AsSymbol());
+	}
+	ASSERT_NE(table.Find("print"), nullptr);
+	ASSERT_EQ(Value::Shared("print", table).AsSymbol(), table.Find("print"));
+}
+
+TEST(StringTests, ConcatenationOfLiterals) {
+	std::stringstream out;
+	RunScript(R"(
+		PUSH b
+		PUSH a
+		ADD
+		CALL print
+	)", out);
+
+	ASSERT_EQ(out.str(), "ab");
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include <iostream>
+
+#include "theatre/value.hh"
+
+using namespace theatre;
+
+static const std::vector<Any> Samples = {
+	Any(), Any(0), Any(7), Any(-3), Any(2.5f), Any(-0.0f), Any(true), Any("text"), Any(""),
+};
+
+template <typename F, typename G>
+static void AssertSameSemantics(F anyOp, G valueOp) {
+	for (const Any& a : Samples) {
+		for (const Any& b : Samples) {
+			std::string expected, actual;
+			try {
+				expected = anyOp(a, b).ToString();
+			} catch (OperationError& ex) {
+				expected = std::string("error: ") + ex.what();
+			}
+			try {
+				actual = valueOp(Value(a), Value(b)).ToString();
+			} catch (OperationError& ex) {
+				actual = std::string("error: ") + ex.what();
+			}
+			ASSERT_EQ(expected, actual) << a << " and " << b;
+		}
+	}
+}
+
+TEST(ValueTests, IsEightBytes) {
+	ASSERT_EQ(sizeof(Value), 8);
+}
+
+TEST(ValueTests, RoundTripsAny) {
+	for (const Any& any : Samples) {
+		const Any back = Value(any).ToAny();
+		ASSERT_EQ(static_cast<const AnyVariant&>(back), static_cast<const AnyVariant&>(any));
+	}
+}
+
+TEST(ValueTests, ArithmeticMatchesAny) {
+	AssertSameSemantics([](const Any& a, const Any& b) { return a + b; },
+	                    [](const Value& a, const Value& b) { return a + b; });
+	AssertSameSemantics([](const Any& a, const Any& b) { return a - b; },
+	                    [](const Value& a, const Value& b) { return a - b; });
+	AssertSameSemantics([](const Any& a, const Any& b) { return a * b; },
+	                    [](const Value& a, const Value& b) { return a * b; });
+}
+
+TEST(ValueTests, DivisionMatchesAny) {
+	ASSERT_EQ((Value::Int(7) / Value::Int(2)).AsInt(), 3);
+	ASSERT_EQ((Value::Float(7.0f) / Value::Int(2)).AsFloat(), 3.5f);
+	ASSERT_THROW(Value::String("a") / Value::Int(2), OperationError);
+}
+
+TEST(ValueTests, StringsAreShared) {
+	Value a = Value::String("shared");
+	{
+		Value b = a;
+		Value c = std::move(b);
+		ASSERT_TRUE(b.IsMono());
+		ASSERT_EQ(c.Bits(), a.Bits());
+	}
+	ASSERT_EQ(a.AsString(), "shared");
+}
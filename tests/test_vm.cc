@@ -3,48 +3,33 @@
 #include <iostream>
 
 #include "theatre_script.hh"
+#include "vm_scripts.hh"
 
 using namespace theatre;
 
 TEST(VmTests, Sum) {
-	Any result = RunScript(R"(
-		PUSH 5
-		PUSH 7
-		ADD
-	)");
+	Any result = RunScript(SUM_SCRIPT);
 	
 	ASSERT_STREQ(result.GetTypeName(), "int");
 	ASSERT_EQ(result.Extract<int>(), 12);
 }
 
 TEST(VmTests, Subtract) {
-	Any result = RunScript(R"(
-		PUSH 7
-		PUSH 2
-		SUB
-	)");
+	Any result = RunScript(SUBTRACT_SCRIPT);
 	
 	ASSERT_STREQ(result.GetTypeName(), "int");
 	ASSERT_EQ(result.Extract<int>(), -5);
 }
 
 TEST(VmTests, Multiply) {
-	Any result = RunScript(R"(
-		PUSH 10
-		PUSH 5
-		MUL
-	)");
+	Any result = RunScript(MULTIPLY_SCRIPT);
 	
 	ASSERT_STREQ(result.GetTypeName(), "int");
 	ASSERT_EQ(result.Extract<int>(), 50);
 }
 
 TEST(VmTests, Divide) {
-	Any result = RunScript(R"(
-		PUSH 5
-		PUSH 10
-		DIV
-	)");
+	Any result = RunScript(DIVIDE_SCRIPT);
 	
 	ASSERT_STREQ(result.GetTypeName(), "int");
 	ASSERT_EQ(result.Extract<int>(), 2);
@@ -54,13 +39,279 @@ TEST(VmTests, StandardOutput) {
 	
 	std::stringstream dummyCout{};
 
-	Any result = RunScript(R"(
-		PUSH 3
-		PUSH 4
-		ADD
-		PUSH Sum is: {}
-		CALL print
-	)", dummyCout);
+	Any result = RunScript(STANDARD_OUTPUT_SCRIPT, dummyCout);
 	
 	ASSERT_EQ(dummyCout.str(), "Sum is: 7");
-}
\ No newline at end of file
+}
+
+TEST(VmTests, RunInPlace) {
+	const std::vector<Command> program = ParseScript(RUN_IN_PLACE_SCRIPT);
+
+	VirtualMachine vm;
+	vm.Init();
+	vm.Run(program);
+
+	ASSERT_EQ(vm.PeekStack().Extract<int>(), 10);
+}
+
+TEST(VmTests, ExecuteIsPure) {
+	VirtualMachine vm;
+	VirtualMachine next = vm.Execute(*ParseLine("PUSH 1"));
+
+	ASSERT_TRUE(vm.IsStackEmpty());
+	ASSERT_EQ(next.PeekStack().Extract<int>(), 1);
+}
+
+TEST(VmTests, OlderMachinesAreUnaffected) {
+	VirtualMachine vm;
+	vm.Init();
+	vm = vm.PushStack(Any(3)).PushStack(Any(4));
+
+	VirtualMachine sum = vm.Execute(*ParseLine("ADD"));
+	VirtualMachine product = vm.Execute(*ParseLine("MUL"));
+	vm.Register("later", [](HookContext&&) { return Any(); });
+
+	ASSERT_EQ(sum.PeekStack().Extract<int>(), 7);
+	ASSERT_EQ(product.PeekStack().Extract<int>(), 12);
+	ASSERT_EQ(vm.PeekStack().Extract<int>(), 4);
+	ASSERT_THROW(sum.GetHook("later"), VmError);
+	ASSERT_EQ(vm.GetHook("later").name, "later");
+}
+
+TEST(VmTests, ParsesScriptViews) {
+	// only the first two lines are part of the view
+	const std::string text = "PUSH 5\r\n\n  PUSH 2.5\nPUSH 7\nADD";
+	const std::vector<Command> program = ParseScript(std::string_view(text).substr(0, 19));
+
+	ASSERT_EQ(program.size(), 2);
+	ASSERT_EQ(program[0].value.Extract<int>(), 5);
+	ASSERT_FLOAT_EQ(program[1].value.Extract<float>(), 2.5f);
+
+	ASSERT_EQ(RunScript(std::string_view(text).substr(0, 6)).Extract<int>(), 5);
+	ASSERT_EQ(Any::Parse("-3").Extract<std::string>(), "-3");
+	ASSERT_THROW(Any::Parse("99999999999"), std::out_of_range);
+}
+
+TEST(VmTests, UnknownHookFailsAtLoad) {
+	VirtualMachine vm;
+	vm.Init();
+
+	try {
+		vm.Run({ *ParseLine("PUSH 1"), *ParseLine("CALL missing") });
+		FAIL() << "Expected the program to be rejected";
+	} catch (VmError& ex) {
+		ASSERT_STREQ(ex.what(), "No external hook found with name: missing");
+	}
+	// nothing ran
+	ASSERT_TRUE(vm.IsStackEmpty());
+}
+
+TEST(VmTests, ReregisteringReplacesHook) {
+	VirtualMachine vm;
+	vm.Register("value", [](HookContext&&) { return Any(1); });
+	const Bytecode program = Assemble({ *ParseLine("CALL value") });
+
+	VirtualMachine before = vm;
+	vm.Register("value", [](HookContext&&) { return Any(2); });
+
+	Bytecode copy = program;
+	before.Run(copy);
+	copy = program;
+	vm.Run(copy);
+
+	ASSERT_EQ(before.PeekStack().Extract<int>(), 1);
+	ASSERT_EQ(vm.PeekStack().Extract<int>(), 2);
+}
+
+static VirtualMachine RunWithHistory(HistoryMode mode, size_t capacity = DEFAULT_HISTORY_CAPACITY) {
+	std::vector<Command> program;
+	for (const char* line : { "PUSH 1", "PUSH 2", "ADD", "PUSH 3", "MUL" }) {
+		program.emplace_back(*ParseLine(line));
+	}
+
+	VirtualMachine vm;
+	vm.SetHistoryMode(mode, capacity);
+	vm.Run(program);
+	return vm;
+}
+
+TEST(VmTests, HistoryOffByDefault) {
+	VirtualMachine vm;
+	vm.Run({ *ParseLine("PUSH 1") });
+
+	ASSERT_EQ(vm.GetHistory().GetMode(), HistoryMode::OFF);
+	ASSERT_TRUE(vm.GetHistory().IsEmpty());
+}
+
+TEST(VmTests, HistoryKeepsLastN) {
+	VirtualMachine vm = RunWithHistory(HistoryMode::LAST_N, 2);
+
+	std::stringstream ss;
+	ss << vm;
+
+	ASSERT_EQ(vm.GetHistory().Size(), 2);
+	ASSERT_EQ(ss.str(), "Virtual machine\nStack:\n- 9\n\nHistory:\n- MUL (mono)\n- PUSH 3\n");
+}
+
+TEST(VmTests, HistoryKeepsOnlyLastNOperands) {
+	VirtualMachine vm;
+	vm.SetHistoryMode(HistoryMode::LAST_N, 3);
+	for (int i = 0; i < 1000; i++) {
+		vm.Run({ Command{ Opcode::PUSH, Any(std::format("program {}", i)) }, *ParseLine("PUSH 1.5") });
+		vm = vm.Execute(Command{ Opcode::PUSH, Any(i) });
+	}
+
+	std::vector<std::string> operands;
+	vm.GetHistory().ForEach([&](const HistoryEntry& entry) {
+		operands.emplace_back(entry.operand.ToString());
+	});
+	ASSERT_EQ(operands, std::vector<std::string>({ "999", "1.500000", "program 999" }));
+}
+
+TEST(VmTests, HistoryFull) {
+	VirtualMachine vm = RunWithHistory(HistoryMode::FULL);
+	vm = vm.Execute(*ParseLine("PUSH 3"));
+
+	std::vector<Opcode> codes;
+	std::vector<Value> operands;
+	vm.GetHistory().ForEach([&](const HistoryEntry& entry) {
+		codes.emplace_back(entry.code);
+		operands.emplace_back(entry.operand);
+	});
+
+	const std::vector<Opcode> expected = {
+		Opcode::PUSH, Opcode::MUL, Opcode::PUSH, Opcode::ADD, Opcode::PUSH, Opcode::PUSH
+	};
+	ASSERT_EQ(codes, expected);
+	ASSERT_EQ(operands.front().AsInt(), 3);
+	ASSERT_TRUE(operands[1].IsMono());
+}
+
+TEST(VmTests, HooksTakeTheirArity) {
+	VirtualMachine vm;
+	vm.Register("pair", [](HookContext&& ctx) {
+		// args[0] is the top of the stack
+		return Any(ctx.args[0].AsInt() * 10 + ctx.args[1].AsInt());
+	}, 2);
+
+	vm.Run({ *ParseLine("PUSH 1"), *ParseLine("PUSH 2"), *ParseLine("PUSH 3"), *ParseLine("CALL pair") });
+	ASSERT_EQ(vm.PeekStack().Extract<int>(), 32);
+
+	Any bottom;
+	vm = vm.PopStack(&bottom).PopStack(&bottom);
+	ASSERT_EQ(bottom.Extract<int>(), 1);
+	ASSERT_TRUE(vm.IsStackEmpty());
+}
+
+TEST(VmTests, HookArgumentsConvertToAny) {
+	VirtualMachine vm;
+	vm.Register("describe", [](HookContext&& ctx) {
+		const Any count = ctx.args.ToAny(1);
+		return Any(std::format("{} x{}", ctx.args[0].Extract<std::string>(), count.Extract<int>()));
+	}, 2);
+
+	vm.Run({ *ParseLine("PUSH 3"), *ParseLine("PUSH apple"), *ParseLine("CALL describe") });
+	ASSERT_EQ(vm.PeekStack().Extract<std::string>(), "apple x3");
+	ASSERT_THROW(Value::Int(1).Extract<float>(), OperationError);
+}
+
+TEST(VmTests, HooksSeeTheRunningMachine) {
+	const auto Program = [] {
+		return std::vector<Command>{ *ParseLine("PUSH 10"), *ParseLine("PUSH 20"), *ParseLine("CALL inspect"),
+		                             *ParseLine("PUSH 1"), *ParseLine("ADD") };
+	};
+	std::vector<bool> empty;
+	VirtualMachine vm;
+	vm.Register("inspect", [&empty](HookContext&& ctx) {
+		empty.emplace_back(ctx.vm.IsStackEmpty());
+		ctx.vm = ctx.vm.PushStack(99);
+		return Any();
+	}, 0);
+
+	VirtualMachine executed = vm;
+	for (const Command& cmd : Program()) {
+		executed = executed.Execute(cmd);
+	}
+	vm.Run(Program());
+
+	ASSERT_EQ(empty, std::vector<bool>({ false, false }));
+	for (VirtualMachine* machine : { &vm, &executed }) {
+		std::vector<int> values;
+		while (!machine->IsStackEmpty()) {
+			Any value;
+			*machine = machine->PopStack(&value);
+			values.emplace_back(value.Extract<int>());
+		}
+		ASSERT_EQ(values, std::vector<int>({ 100, 20, 10 }));
+	}
+}
+
+TEST(VmTests, ExplicitArgumentCount) {
+	std::stringstream out;
+	VirtualMachine vm("test", out);
+	vm.Init();
+
+	const std::vector<Command> program = ParseScript(EXPLICIT_ARGUMENT_COUNT_SCRIPT);
+	VirtualMachine pure = vm;
+	for (const Command& cmd : program) {
+		pure = pure.Execute(cmd);
+	}
+	vm.Run(program);
+
+	ASSERT_EQ(out.str(), "3 and 43 and 4");
+	ASSERT_EQ(vm.PeekStack().Extract<int>(), 5);
+	ASSERT_EQ(pure.PeekStack().Extract<int>(), 5);
+}
+
+TEST(VmTests, TooFewArguments) {
+	VirtualMachine vm;
+	vm.Register("pair", [](HookContext&&) { return Any(); }, 2);
+
+	try {
+		vm.Run({ *ParseLine("PUSH 1"), *ParseLine("CALL pair") });
+		FAIL() << "Expected the call to fail";
+	} catch (VmError& ex) {
+		ASSERT_STREQ(ex.what(), "Function pair expects 2 args but 1 were given.");
+	}
+}
+
+TEST(VmTests, ReusesLinkage) {
+	VirtualMachine vm;
+	vm.Register("nothing", [](HookContext&&) { return Any(); });
+	Bytecode program = Assemble({ *ParseLine("PUSH 1"), *ParseLine("CALL nothing 1") });
+
+	vm.Run(program);
+	const std::shared_ptr<const Linkage> first = program.linkage;
+	vm.Run(program);
+	ASSERT_EQ(program.linkage, first);
+
+	vm.Register("other", [](HookContext&&) { return Any(); });
+	vm.Run(program);
+	ASSERT_NE(program.linkage, first);
+}
+
+TEST(VmTests, SharesStandardLibrary) {
+	VirtualMachine a, b;
+	a.Init();
+	b.Init();
+
+	ASSERT_EQ(&a.GetHook("print"), &b.GetHook("print"));
+
+	a.Register("print", [](HookContext&&) { return Any(1); });
+	ASSERT_NE(&a.GetHook("print"), &b.GetHook("print"));
+	ASSERT_EQ(&b.GetHook("print"), VirtualMachine::StandardLibrary()->Find(StringTable::Global().Find("print")));
+}
+
+TEST(VmTests, HostRegistry) {
+	auto registry = std::make_shared<HookRegistry>(*VirtualMachine::StandardLibrary());
+	registry->Bind("twice", [](int value) { return value * 2; });
+	const std::shared_ptr<const HookRegistry> shared = registry;
+
+	std::stringstream out;
+	VirtualMachine vm("host", out);
+	vm.SetRegistry(shared);
+	vm.Run({ *ParseLine("PUSH 21"), *ParseLine("CALL twice"), *ParseLine("PUSH {}"), *ParseLine("CALL print") });
+
+	ASSERT_EQ(out.str(), "42");
+	ASSERT_EQ(shared->Size(), 4);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// Programs of the VmTests. The optimizer tests run every one of them with and
+// without optimizing, so both paths are checked against the same list.
+
+inline constexpr const char* SUM_SCRIPT = R"(
+	PUSH 5
+	PUSH 7
+	ADD
+)";
+
+inline constexpr const char* SUBTRACT_SCRIPT = R"(
+	PUSH 7
+	PUSH 2
+	SUB
+)";
+
+inline constexpr const char* MULTIPLY_SCRIPT = R"(
+	PUSH 10
+	PUSH 5
+	MUL
+)";
+
+inline constexpr const char* DIVIDE_SCRIPT = R"(
+	PUSH 5
+	PUSH 10
+	DIV
+)";
+
+inline constexpr const char* STANDARD_OUTPUT_SCRIPT = R"(
+	PUSH 3
+	PUSH 4
+	ADD
+	PUSH Sum is: {}
+	CALL print
+)";
+
+inline constexpr const char* RUN_IN_PLACE_SCRIPT = "PUSH 2\nPUSH 3\nMUL\nPUSH 4\nADD";
+
+inline constexpr const char* EXPLICIT_ARGUMENT_COUNT_SCRIPT = "PUSH 5\nPUSH 4\nPUSH 3\nPUSH {} and {}\nCALL print 3";
+
+inline constexpr const char* VM_TEST_SCRIPTS[] = {
+	SUM_SCRIPT, SUBTRACT_SCRIPT, MULTIPLY_SCRIPT, DIVIDE_SCRIPT, STANDARD_OUTPUT_SCRIPT,
+	RUN_IN_PLACE_SCRIPT, EXPLICIT_ARGUMENT_COUNT_SCRIPT,
+};